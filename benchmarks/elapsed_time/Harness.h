@@ -0,0 +1,446 @@
+#ifndef __HARNESS_H__
+#define __HARNESS_H__
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "nlohmann/json.hpp"
+
+/**
+ *  Runs `t_work` once.
+ *  @return the time it took in nanoseconds, measured with `steady_clock`
+ *          which is answered from the vDSO on Linux.
+ */
+template<typename F>
+double timeNanos(F&& t_work) {
+    auto start = std::chrono::steady_clock::now();
+    t_work();
+    std::chrono::duration<double, std::nano> taken =
+        std::chrono::steady_clock::now() - start;
+    return taken.count();
+}
+
+/**
+ *  @return the smallest time that `timeNanos` measures for an empty
+ *          operation, which is subtracted from the latencies of single
+ *          operations.
+ */
+inline uint64_t clockOverhead() {
+    static const uint64_t overhead = [] {
+        double least = 1e9;
+        for (size_t i = 0; i < 1000; ++i) {
+            least = std::min(least, timeNanos([] {}));
+        }
+        return (uint64_t)least;
+    }();
+    return overhead;
+}
+
+/**
+ *  Represents a histogram of latencies in the style of HdrHistogram: the
+ *  values are counted in buckets whose width doubles with every power of 2,
+ *  and every power of 2 is split in `SUB_BUCKETS` buckets, so a value is
+ *  reported with a relative error of at most `1 / SUB_BUCKETS`, however
+ *  large it is.
+ */
+class Histogram {
+public:
+    /** The number of buckets every power of 2 is split in. */
+    static const size_t SUB_BUCKET_BITS = 5;
+    static const size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+    Histogram() : m_counts((64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS, 0) {}
+
+    void record(uint64_t t_value) {
+        ++m_counts[index(t_value)];
+        ++m_count;
+        m_max = std::max(m_max, t_value);
+    }
+
+    size_t getCount() const { return m_count; }
+
+    uint64_t getMax() const { return m_max; }
+
+    /**
+     *  @param t_percentile a percentile in [0, 100]
+     *  @return the highest value which is counted in the same bucket as
+     *          the value at `t_percentile`, or the exact maximum for 100.
+     */
+    uint64_t getValueAtPercentile(double t_percentile) const {
+        if (m_count == 0) {
+            return 0;
+        }
+        size_t rank = std::max<size_t>(1,
+            (size_t)std::ceil(t_percentile / 100 * m_count));
+        size_t seen = 0;
+        for (size_t i = 0; i < m_counts.size(); ++i) {
+            seen += m_counts[i];
+            if (seen >= rank) {
+                return std::min(m_max, highestValue(i));
+            }
+        }
+        return m_max;
+    }
+
+private:
+    std::vector<uint64_t> m_counts;
+    size_t m_count = 0;
+    uint64_t m_max = 0;
+
+    /**
+     *  The values below `2 * SUB_BUCKETS` have a bucket each, larger ones
+     *  share a bucket with the values of the same `SUB_BUCKET_BITS + 1`
+     *  most significant bits.
+     */
+    static size_t index(uint64_t t_value) {
+        if (t_value < SUB_BUCKETS) {
+            return t_value;
+        }
+        size_t shift = 63 - __builtin_clzll(t_value) - SUB_BUCKET_BITS;
+        return shift * SUB_BUCKETS + (t_value >> shift);
+    }
+
+    static uint64_t highestValue(size_t t_index) {
+        if (t_index < 2 * SUB_BUCKETS) {
+            return t_index;
+        }
+        size_t shift = t_index / SUB_BUCKETS - 1;
+        uint64_t lowest = (uint64_t)(t_index - shift * SUB_BUCKETS) << shift;
+        return lowest + ((uint64_t)1 << shift) - 1;
+    }
+};
+
+/** The percentiles that are reported of every `Histogram`. */
+const double PERCENTILES[] = {50, 75, 90, 99, 99.9, 99.99, 100};
+
+inline void to_json(nlohmann::json& t_j, const Histogram& t_histogram) {
+    t_j["count"] = t_histogram.getCount();
+    t_j["max_ns"] = t_histogram.getMax();
+    for (double percentile : PERCENTILES) {
+        t_j["percentiles"].push_back(
+            {percentile, t_histogram.getValueAtPercentile(percentile)});
+    }
+}
+
+/**
+ *  A single run of a benchmark, which either times how long it spent
+ *  allocating and deallocating or records the latency of every operation
+ *  in a `Histogram` if `allocationLatencies` and `deallocationLatencies`
+ *  are set (see `Harness::run`).
+ *  @par
+ *  A benchmark passes its operations one by one to `allocate` and
+ *  `deallocate`, which are timed as a batch unless the latencies are
+ *  recorded, or times a batch of operations it cannot split up with
+ *  `timeAllocation` and `timeDeallocation`, whose latencies are not
+ *  recorded.
+ */
+struct Trial {
+    double allocationNanos = 0;
+    size_t allocations = 0;
+    double deallocationNanos = 0;
+    size_t deallocations = 0;
+    Histogram* allocationLatencies = nullptr;
+    Histogram* deallocationLatencies = nullptr;
+
+    /**
+     *  Makes `t_n` allocations by calling `t_alloc(i)` for every i < t_n.
+     */
+    template<typename F>
+    void allocate(size_t t_n, F&& t_alloc) {
+        run(t_n, t_alloc, allocationNanos, allocationLatencies);
+        allocations += t_n;
+    }
+
+    /**
+     *  Makes `t_n` deallocations by calling `t_dealloc(i)` for every
+     *  i < t_n.
+     */
+    template<typename F>
+    void deallocate(size_t t_n, F&& t_dealloc) {
+        run(t_n, t_dealloc, deallocationNanos, deallocationLatencies);
+        deallocations += t_n;
+    }
+
+    /**
+     *  Times `t_work`, which makes `t_n` allocations.
+     */
+    template<typename F>
+    void timeAllocation(size_t t_n, F&& t_work) {
+        allocationNanos += timeNanos(t_work);
+        allocations += t_n;
+    }
+
+    /**
+     *  Times `t_work`, which makes `t_n` deallocations.
+     */
+    template<typename F>
+    void timeDeallocation(size_t t_n, F&& t_work) {
+        deallocationNanos += timeNanos(t_work);
+        deallocations += t_n;
+    }
+
+private:
+    template<typename F>
+    static void run(size_t t_n, F& t_op, double& t_nanos,
+                    Histogram* t_latencies) {
+        if (!t_latencies) {
+            t_nanos += timeNanos([&] {
+                for (size_t i = 0; i < t_n; ++i) {
+                    t_op(i);
+                }
+            });
+            return;
+        }
+        uint64_t overhead = clockOverhead();
+        for (size_t i = 0; i < t_n; ++i) {
+            uint64_t nanos = (uint64_t)timeNanos([&] { t_op(i); });
+            t_latencies->record(nanos > overhead ? nanos - overhead : 0);
+        }
+    }
+};
+
+/**
+ *  The statistics of the samples of a number of trials.
+ */
+struct Summary {
+    double median = 0;
+    double p99 = 0;
+    double mean = 0;
+    double stddev = 0;
+    double min = 0;
+    double max = 0;
+};
+
+/**
+ *  @return the `Summary` of `t_samples`, the percentiles are nearest-rank
+ *          and the standard deviation is the sample standard deviation.
+ */
+inline Summary summarize(std::vector<double> t_samples) {
+    Summary summary;
+    if (t_samples.empty()) {
+        return summary;
+    }
+    std::sort(t_samples.begin(), t_samples.end());
+    size_t n = t_samples.size();
+    summary.median = n % 2 ? t_samples[n / 2] :
+        (t_samples[n / 2 - 1] + t_samples[n / 2]) / 2;
+    summary.p99 = t_samples[(size_t)std::ceil(0.99 * n) - 1];
+    summary.min = t_samples.front();
+    summary.max = t_samples.back();
+    for (double sample : t_samples) {
+        summary.mean += sample / n;
+    }
+    if (n > 1) {
+        double squares = 0;
+        for (double sample : t_samples) {
+            squares += (sample - summary.mean) * (sample - summary.mean);
+        }
+        summary.stddev = std::sqrt(squares / (n - 1));
+    }
+    return summary;
+}
+
+inline void to_json(nlohmann::json& t_j, const Summary& t_summary) {
+    t_j = nlohmann::json{{"median_ns", t_summary.median},
+                         {"p99_ns", t_summary.p99},
+                         {"mean_ns", t_summary.mean},
+                         {"stddev_ns", t_summary.stddev},
+                         {"min_ns", t_summary.min},
+                         {"max_ns", t_summary.max}};
+}
+
+/**
+ *  Represents the harness of the elapsed time benchmarks, which runs every
+ *  benchmark a number of times and holds a json object with the statistics
+ *  of the runs which is dumped to a given file when it is destroyed.
+ *  @par
+ *  The runs are configured with environment variables, so that the command
+ *  line arguments of the benchmarks stay the same:
+ *  - `RPOOLS_BENCH_WARMUPS`: the number of runs that are not recorded
+ *    (default: 2)
+ *  - `RPOOLS_BENCH_TRIALS`: the number of runs that are recorded
+ *    (default: 10)
+ *  - `RPOOLS_BENCH_CPU`: the CPU that the benchmark is pinned to, threads
+ *    are pinned to the following CPUs (see `pinThread`); by default the
+ *    benchmark is not pinned
+ *  - `RPOOLS_BENCH_LATENCIES`: 0 to skip the run which records the latency
+ *    of every operation (see `Trial`)
+ *
+ *  @par
+ *  This is a sample of what this class might dump to a file, the times of
+ *  the `allocation` and `deallocation` entries are per operation and the
+ *  `allocation_time` and `deallocation_time` are the median milliseconds
+ *  of a whole run (see plot_elapsed_time.py), the latencies are the
+ *  percentiles of a `Histogram` of the operations of one more run:
+ *  ```
+ *   {
+ *       "allocators": {
+ *           "LinkedPool": {
+ *               "allocation": {
+ *                   "max_ns": 10.63,
+ *                   "mean_ns": 9.87,
+ *                   "median_ns": 9.81,
+ *                   "min_ns": 9.62,
+ *                   "p99_ns": 10.63,
+ *                   "stddev_ns": 0.27
+ *               },
+ *               "allocation_latency": {
+ *                   "count": 100000,
+ *                   "max_ns": 48113,
+ *                   "percentiles": [[50, 9], [75, 10], ..., [100, 48113]]
+ *               },
+ *               "allocation_time": 0.981,
+ *               "deallocation": { ... },
+ *               "deallocation_latency": { ... },
+ *               "deallocation_time": 0.712
+ *           },
+ *           ...
+ *       },
+ *       "clock": "steady_clock",
+ *       "cpu": null,
+ *       "number_of_allocations": 100000,
+ *       "trials": 10,
+ *       "warmups": 2
+ *   }
+ *  ```
+ */
+class Harness {
+public:
+    nlohmann::json j;
+
+    /**
+     *  Reads the configuration of the runs and pins the calling thread.
+     *  @param t_fileName the file in which the json will be dumped
+     *  @param t_numOfAllocs the value of the key `number_of_allocations`
+     */
+    Harness(const std::string& t_fileName, size_t t_numOfAllocs)
+        : m_f(t_fileName),
+          m_warmups(std::max(0l, readVariable("RPOOLS_BENCH_WARMUPS", 2))),
+          m_trials(std::max(1l, readVariable("RPOOLS_BENCH_TRIALS", 10))),
+          m_cpu(readVariable("RPOOLS_BENCH_CPU", -1)),
+          m_latencies(readVariable("RPOOLS_BENCH_LATENCIES", 1) != 0) {
+        j["number_of_allocations"] = t_numOfAllocs;
+        j["warmups"] = m_warmups;
+        j["trials"] = m_trials;
+        j["clock"] = "steady_clock";
+        j["cpu"] = m_cpu < 0 ? nlohmann::json() : nlohmann::json(m_cpu);
+        pinThread(0);
+    }
+
+    /**
+     *  Runs `t_run` the configured number of times.
+     *  @param t_run the benchmark, which returns a sample
+     *  @return the samples of the recorded runs.
+     */
+    template<typename F>
+    std::vector<double> repeat(F&& t_run) {
+        for (size_t i = 0; i < m_warmups; ++i) {
+            t_run();
+        }
+        std::vector<double> samples;
+        for (size_t i = 0; i < m_trials; ++i) {
+            samples.push_back(t_run());
+        }
+        return samples;
+    }
+
+    /**
+     *  Runs the benchmark of an allocator the configured number of times
+     *  and records its statistics, then runs it once more to record the
+     *  latencies of its operations.
+     *  @param t_allocatorName the name of the allocator
+     *  @param t_run the benchmark, which runs with the given `Trial`
+     */
+    template<typename F>
+    void run(const std::string& t_allocatorName, F&& t_run) {
+        std::vector<Trial> trials;
+        repeat([&] {
+            trials.emplace_back();
+            t_run(trials.back());
+            return 0.0;
+        });
+        trials.erase(trials.begin(), trials.begin() + m_warmups);
+        std::vector<double> allocs;
+        std::vector<double> deallocs;
+        for (const Trial& trial : trials) {
+            allocs.push_back(trial.allocationNanos /
+                             std::max<size_t>(1, trial.allocations));
+            deallocs.push_back(trial.deallocationNanos /
+                               std::max<size_t>(1, trial.deallocations));
+        }
+        Summary alloc = summarize(allocs);
+        Summary dealloc = summarize(deallocs);
+        auto& entry = j["allocators"][t_allocatorName];
+        entry["allocation"] = alloc;
+        entry["deallocation"] = dealloc;
+        entry["allocation_time"] =
+            alloc.median * trials.front().allocations / 1e6;
+        entry["deallocation_time"] =
+            dealloc.median * trials.front().deallocations / 1e6;
+        if (m_latencies) {
+            Histogram allocLatencies;
+            Histogram deallocLatencies;
+            Trial trial;
+            trial.allocationLatencies = &allocLatencies;
+            trial.deallocationLatencies = &deallocLatencies;
+            t_run(trial);
+            if (allocLatencies.getCount()) {
+                entry["allocation_latency"] = allocLatencies;
+            }
+            if (deallocLatencies.getCount()) {
+                entry["deallocation_latency"] = deallocLatencies;
+            }
+        }
+    }
+
+    /**
+     *  Pins the calling thread to the `t_thread`-th CPU after the configured
+     *  one, if the benchmark is pinned.
+     */
+    void pinThread(size_t t_thread) const {
+#ifdef __linux__
+        if (m_cpu < 0) {
+            return;
+        }
+        size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET((m_cpu + t_thread) % cpus, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+        (void)t_thread;
+#endif
+    }
+
+    virtual ~Harness() {
+        m_f << j.dump(4);
+    }
+
+private:
+    std::ofstream m_f;
+    size_t m_warmups;
+    size_t m_trials;
+    long m_cpu;
+    bool m_latencies;
+
+    /**
+     *  @return the value of the environment variable `t_name` or
+     *          `t_default` if it is not set.
+     */
+    static long readVariable(const char* t_name, long t_default) {
+        const char* value = std::getenv(t_name);
+        return value ? std::strtol(value, nullptr, 10) : t_default;
+    }
+};
+
+#endif // __HARNESS_H__
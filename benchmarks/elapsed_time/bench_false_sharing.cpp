@@ -0,0 +1,108 @@
+/**
+ *  @file bench_false_sharing.cpp
+ *  Every thread allocates a number of objects from its own
+ *  `GlobalLinkedPool`, all of them in neighbouring size classes, and then
+ *  deallocates them.
+ *  The pools are laid out like the size classes of `GlobalPools`, once
+ *  packed next to each other and once with every pool on its own cache
+ *  lines (see CacheAligned.hpp). The threads never share a pool, so the
+ *  difference between the two is the cost of false sharing.
+ *  @par
+ *  The first command line argument sets the number of objects per thread
+ *  and the second one the number of threads (default: the number of CPUs).
+ *  @par
+ *  The results will be written to a file called **sharing_time_taken.json**.
+ *  The times are wall-clock, so the time per operation is the time of all
+ *  threads divided by the number of operations of all threads.
+ *  @see Harness
+ */
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Harness.h"
+#include "rpools/allocators/GlobalLinkedPool.hpp"
+#include "rpools/tools/CacheAligned.hpp"
+#include "rpools/tools/mallocator.hpp"
+
+using rpools::CacheAligned;
+using rpools::GlobalLinkedPool;
+
+/**
+ *  A `GlobalLinkedPool` that shares its cache lines with its neighbours.
+ */
+struct Packed {
+    GlobalLinkedPool value;
+
+    explicit Packed(size_t t_size) : value(t_size) {}
+};
+
+/**
+ *  Runs `t_work(thread)` on `t_threads` threads, every thread pinned by
+ *  `t_h` if it is configured to.
+ */
+template<typename F>
+void runThreads(const Harness& t_h, size_t t_threads, F t_work) {
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < t_threads; ++t) {
+        threads.emplace_back([&t_h, &t_work, t] {
+            t_h.pinThread(t);
+            t_work(t);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+/**
+ *  Allocate and deallocate `bound` objects per thread, every thread using
+ *  the pool of the size class `8 * (thread + 1)`.
+ *  @tparam E the entry type of the array of pools
+ *  @param bound the number of (de)allocations per thread
+ *  @param numOfThreads the number of threads
+ *  @param h the harness which pins the threads
+ *  @param trial the trial which times the (de)allocations of all threads
+ */
+template<typename E>
+void benchLayout(size_t bound, size_t numOfThreads, const Harness& h,
+                 Trial& trial) {
+    std::vector<E, mallocator<E>> pools;
+    pools.reserve(numOfThreads);
+    for (size_t t = 0; t < numOfThreads; ++t) {
+        pools.emplace_back(8 * (t + 1));
+    }
+    std::vector<std::vector<void*>> objs(numOfThreads,
+                                         std::vector<void*>(bound));
+    trial.timeAllocation(bound * numOfThreads, [&] {
+        runThreads(h, numOfThreads, [&](size_t t) {
+            for (size_t i = 0; i < bound; ++i) {
+                objs[t][i] = pools[t].value.allocate();
+            }
+        });
+    });
+    trial.timeDeallocation(bound * numOfThreads, [&] {
+        runThreads(h, numOfThreads, [&](size_t t) {
+            for (size_t i = 0; i < bound; ++i) {
+                pools[t].value.deallocate(objs[t][i]);
+            }
+        });
+    });
+}
+
+int main(int argc, char *argv[]) {
+    size_t BOUND = argc > 1 ? std::stoul(argv[1]) : 100000;
+    size_t THREADS = argc > 2 ? std::stoul(argv[2]) :
+        std::max(2u, std::thread::hardware_concurrency());
+    Harness h("sharing_time_taken.json", BOUND);
+    h.j["number_of_threads"] = THREADS;
+    h.run("packed", [&](Trial& trial) {
+        benchLayout<Packed>(BOUND, THREADS, h, trial);
+    });
+    h.run("cache aligned", [&](Trial& trial) {
+        benchLayout<CacheAligned<GlobalLinkedPool>>(BOUND, THREADS, h, trial);
+    });
+    return 0;
+}
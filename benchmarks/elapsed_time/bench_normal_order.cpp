@@ -9,14 +9,14 @@
  *  that will be created and destroyed.
  *  @par
  *  The results will be written to a file called **normal_time_taken.json**.
- *  @see JSONWriter
+ *  @see Harness
  */
 
 #include <vector>
 #include <string>
 #include <iostream>
 
-#include "Utility.h"
+#include "Harness.h"
 #include "unit_test/TestObject.h"
 #ifdef INCLUDE_BOOST
 #include <boost/pool/object_pool.hpp>
@@ -28,77 +28,58 @@ using rpools::LinkedPool;
 
 /**
  *  Allocate and deallocate a number of `TestObject`s by using a pool allocator.
- *  @note
- *  The allocation and deallocation times are recorded and written to a file.
  *  @tparam T the type of the pool allocator
  *  @param bound the number of (de)allocations
- *  @param j the JSONWriter which records the speed
- *  @param name the name of the pool allocator which (de)allocates
- *                `TestObject`s
+ *  @param trial the trial which times the (de)allocations
  */
 template<template <typename> class T>
-void benchPool(size_t bound, JSONWriter& j, const std::string& name) {
+void benchPool(size_t bound, Trial& trial) {
     T<TestObject> lp;
     std::vector<TestObject*> objs(bound);
-    std::clock_t start = std::clock();
-    for (size_t i = 0; i < bound; ++i) {
+    trial.allocate(bound, [&](size_t i) {
         objs[i] = reinterpret_cast<TestObject*>(lp.allocate());
-    }
-    j.addAllocation(name, start);
-
-    start = std::clock();
-    for (size_t i = 0; i < bound; ++i) {
+    });
+    trial.deallocate(bound, [&](size_t i) {
         lp.deallocate(objs[i]);
-    }
-    j.addDeallocation(name, start);
+    });
 }
 
 #ifdef INCLUDE_BOOST
 template<template <typename, typename> class T>
-void benchPool(size_t bound, JSONWriter& j, const std::string& name) {
+void benchBoostPool(size_t bound, Trial& trial) {
     T<TestObject, boost::default_user_allocator_malloc_free> bp;
     std::vector<TestObject*> objs(bound);
-    std::clock_t start = std::clock();
-    for (size_t i = 0; i < bound; ++i) {
+    trial.allocate(bound, [&](size_t i) {
         objs[i] = reinterpret_cast<TestObject*>(bp.malloc());
-    }
-    j.addAllocation(name, start);
-
-    start = std::clock();
-    for (size_t i = 0; i < bound; ++i) {
+    });
+    trial.deallocate(bound, [&](size_t i) {
         bp.free(objs[i]);
-    }
-    j.addDeallocation(name, start);
+    });
 }
 #endif
 
 int main(int argc, char *argv[]) {
     size_t BOUND = argc > 1 ? std::stoul(argv[1]) : 10000;
-    JSONWriter j("normal_time_taken.json", BOUND);
-    {
+    Harness h("normal_time_taken.json", BOUND);
+    h.run("new/delete", [&](Trial& trial) {
         std::vector<TestObject*> objs(BOUND);
-        std::clock_t start = std::clock();
-        for (size_t i = 0; i < BOUND; ++i) {
+        trial.allocate(BOUND, [&](size_t i) {
             objs[i] = new TestObject();
-        }
-        j.addAllocation("new/delete", start);
-
-        start = std::clock();
-        for (size_t i = 0; i < BOUND; ++i) {
+        });
+        trial.deallocate(BOUND, [&](size_t i) {
             delete objs[i];
-        }
-        j.addDeallocation("new/delete", start);
-    }
-    {
-        benchPool<LinkedPool>(BOUND, j, "LinkedPool");
-    }
-    {
-        benchPool<MemoryPool>(BOUND, j, "MemoryPool");
-    }
+        });
+    });
+    h.run("LinkedPool", [&](Trial& trial) {
+        benchPool<LinkedPool>(BOUND, trial);
+    });
+    h.run("MemoryPool", [&](Trial& trial) {
+        benchPool<MemoryPool>(BOUND, trial);
+    });
 #ifdef INCLUDE_BOOST
-    {
-        benchPool<boost::object_pool>(BOUND, j, "boost::object_pool");
-    }
+    h.run("boost::object_pool", [&](Trial& trial) {
+        benchBoostPool<boost::object_pool>(BOUND, trial);
+    });
 #endif
     return 0;
 }
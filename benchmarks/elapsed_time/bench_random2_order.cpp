@@ -15,7 +15,10 @@
  *  `MemoryPool` and `boost::object_pool`.
  *  @par
  *  The results will be written to a file called **random2_time_taken.json**
- *  @see JSONWriter
+ *  @par
+ *  Consecutive deallocations are timed together, unless the latency of every
+ *  operation is recorded (see `Trial`).
+ *  @see Harness
  */
 
 #include <vector>
@@ -25,7 +28,7 @@
 #include <cstdlib>
 #include <ctime>
 
-#include "Utility.h"
+#include "Harness.h"
 #include "unit_test/TestObject.h"
 #ifdef INCLUDE_BOOST
 #include <boost/pool/object_pool.hpp>
@@ -35,109 +38,8 @@
 
 using rpools::LinkedPool;
 using std::pair;
-using std::make_pair;
 using std::vector;
 
-/**
- *  Allocates `num` `TestObject`s using `new` which are stored in `vec`.
- *  @param range the range of indices where to store in `vec`
- *  @param vec the vector in which the allocations are saved
- *  @return The number of ms it took to allocate `num` `TestObject`s.
- */
-float allocateN(const pair<size_t, size_t>& range, vector<TestObject*>& vec) {
-    std::clock_t start = std::clock();
-    for (size_t i = range.first; i < range.second; ++i) {
-        vec[i] = new TestObject();
-    }
-    return (std::clock() - start) / (double)(CLOCKS_PER_SEC / 1000);
-}
-
-/**
- *  Deallocates the `TestObject` at a given index in `vec` by using `delete`.
- *  @param index the index in `vec`
- *  @param vec the vector from which the `TestObject` is `delete`d
- *  @return The number of ms it took to deallocate the `TestObject`.
- */
-float deallocateN(size_t index, vector<TestObject*>& vec) {
-    std::clock_t start = std::clock();
-    delete vec[index];
-    return (std::clock() - start) / (double)(CLOCKS_PER_SEC / 1000);
-}
-
-/**
- *  Allocates a number `TestObject`s using a pool allocator which
- *  are stored in `vec`.
- *  @tparam T the type of the pool allocator
- *  @param range the range of indices where to store in `vec`
- *  @param vec the vector in which the allocations are saved
- *  @param lp the pool allocator
- *  @return The number of ms it took to allocate the `TestObject`s.
- */
-template<template <typename> class T>
-float allocateN(const pair<size_t, size_t>& range, vector<TestObject*>& vec,
-               T<TestObject>& lp) {
-    std::clock_t start = std::clock();
-    for (size_t i = range.first; i < range.second; ++i) {
-        vec[i] = (TestObject*) lp.allocate();
-    }
-    return (std::clock() - start) / (double)(CLOCKS_PER_SEC / 1000);
-}
-
-/**
- *  Deallocates the `TestObject` at a given index in `vec` by using a pool
- *  allocator.
- *  @param index the index in `vec`
- *  @param vec the vector from which the `TestObject` is deallocated
- *  @return The number of ms it took to deallocate the `TestObject`.
- */
-template<template <typename> class T>
-float deallocateN(size_t index, vector<TestObject*>& vec, T<TestObject>& lp) {
-    std::clock_t start = std::clock();
-    lp.deallocate(vec[index]);
-    return (std::clock() - start) / (double)(CLOCKS_PER_SEC / 1000);
-}
-
-#ifdef INCLUDE_BOOST
-template<template <typename, typename> class T>
-float allocateN(const pair<size_t, size_t>& range, vector<TestObject*>& vec,
-                T<TestObject, boost::default_user_allocator_malloc_free>& lp) {
-    std::clock_t start = std::clock();
-    for (size_t i = range.first; i < range.second; ++i) {
-        vec[i] = (TestObject*) lp.malloc();
-    }
-    return (std::clock() - start) / (double)(CLOCKS_PER_SEC / 1000);
-}
-
-template<template <typename, typename> class T>
-float deallocateN(size_t index, vector<TestObject*>& vec,
-                  T<TestObject, boost::default_user_allocator_malloc_free>& lp) {
-    std::clock_t start = std::clock();
-    lp.free(vec[index]);
-    return (std::clock() - start) / (double)(CLOCKS_PER_SEC / 1000);
-}
-
-template<template <typename, typename> class T>
-void benchPool(size_t BOUND, JSONWriter& j,
-               const vector<pair<size_t, bool>>& order,
-               const std::string& name) {
-    T<TestObject, boost::default_user_allocator_malloc_free> lp;
-    vector<TestObject*> objs(BOUND);
-    float alloc = 0.0f;
-    float dealloc = 0.0f;
-    size_t startIndex = 0;
-    for (const auto& pair : order) {
-        if (!pair.second) {
-            alloc += allocateN(make_pair(startIndex, startIndex + pair.first), objs, lp);
-            startIndex += pair.first;
-        } else {
-            dealloc += deallocateN(pair.first, objs, lp);
-        }
-    }
-    j.addAllocation(name, alloc);
-    j.addDeallocation(name, dealloc);
-}
-#endif
-
 /** Used for shuffling. */
 size_t SEED = std::chrono::system_clock::now().time_since_epoch().count();
 
@@ -167,38 +69,65 @@ void pushAndPop(vector<pair<size_t, bool>>& vec,
 }
 
 /**
- *  Allocate and deallocate a number of `TestObject`s by using a pool allocator.
+ *  Allocate and deallocate a number of `TestObject`s.
  *  The deallocation sequence is determined by the `order` vector.
- *  @note
- *  The allocation and deallocation times are recorded and written to a file.
- *  @tparam T the type of the pool allocator
  *  @param bound the number of (de)allocations
- *  @param j the JSONWriter which records the speed
  *  @param order the order in which the objects are (de)allocated
- *  @param name the name of the pool allocator which (de)allocates
- *              `TestObject`s
+ *  @param alloc allocates a `TestObject`
+ *  @param dealloc deallocates a `TestObject`
+ *  @param trial the trial which times the (de)allocations
  */
-template<template <typename> class T>
-void benchPool(size_t bound, JSONWriter& j,
-               const vector<pair<size_t, bool>>& order,
-               const std::string& name) {
-    T<TestObject> lp;
+template<typename A, typename D>
+void benchOrder(size_t bound, const vector<pair<size_t, bool>>& order,
+                Trial& trial, A alloc, D dealloc) {
     vector<TestObject*> objs(bound);
-    float alloc = 0.0f;
-    float dealloc = 0.0f;
     size_t startIndex = 0;
-    for (const auto& pair : order) {
-        if (!pair.second) {
-            alloc += allocateN(make_pair(startIndex, startIndex + pair.first), objs, lp);
-            startIndex += pair.first;
+    size_t i = 0;
+    while (i < order.size()) {
+        if (!order[i].second) {
+            trial.allocate(order[i].first, [&](size_t k) {
+                objs[startIndex + k] = alloc();
+            });
+            startIndex += order[i].first;
+            ++i;
         } else {
-            dealloc += deallocateN(pair.first, objs, lp);
+            size_t end = i;
+            while (end < order.size() && order[end].second) {
+                ++end;
+            }
+            trial.deallocate(end - i, [&](size_t k) {
+                dealloc(objs[order[i + k].first]);
+            });
+            i = end;
         }
     }
-    j.addAllocation(name, alloc);
-    j.addDeallocation(name, dealloc);
 }
 
+/**
+ *  Allocate and deallocate a number of `TestObject`s by using a pool allocator.
+ *  @tparam T the type of the pool allocator
+ *  @see benchOrder
+ */
+template<template <typename> class T>
+void benchPool(size_t bound, const vector<pair<size_t, bool>>& order,
+               Trial& trial) {
+    T<TestObject> lp;
+    benchOrder(bound, order, trial,
+        [&] { return reinterpret_cast<TestObject*>(lp.allocate()); },
+        [&](TestObject* t_ptr) { lp.deallocate(t_ptr); });
+}
+
+#ifdef INCLUDE_BOOST
+template<template <typename, typename> class T>
+void benchBoostPool(size_t bound, const vector<pair<size_t, bool>>& order,
+                    Trial& trial) {
+    T<TestObject, boost::default_user_allocator_malloc_free> lp;
+    benchOrder(bound, order, trial,
+        [&] { return reinterpret_cast<TestObject*>(lp.malloc()); },
+        [&](TestObject* t_ptr) { lp.free(t_ptr); });
+}
+#endif
+
 int main(int argc, char *argv[]) {
     size_t BOUND = argc > 1 ? std::stoul(argv[1]) : 10000;
 
@@ -232,33 +161,22 @@ int main(int argc, char *argv[]) {
     }
     pushAndPop(order, allocated.size(), allocated);
 
-    JSONWriter j("random2_time_taken.json", BOUND);
-    {
-        vector<TestObject*> objs(BOUND);
-        float alloc = 0.0f;
-        float dealloc = 0.0f;
-        size_t startIndex = 0;
-        for (const auto& pair : order) {
-            if (!pair.second) {
-                alloc += allocateN(make_pair(startIndex, startIndex + pair.first), objs);
-                startIndex += pair.first;
-            } else {
-                dealloc += deallocateN(pair.first, objs);
-            }
-        }
-        j.addAllocation("new/delete", alloc);
-        j.addDeallocation("new/delete", dealloc);
-    }
-    {
-        benchPool<LinkedPool>(BOUND, j, order, "LinkedPool");
-    }
-    {
-        benchPool<MemoryPool>(BOUND, j, order, "MemoryPool");
-    }
+    Harness h("random2_time_taken.json", BOUND);
+    h.run("new/delete", [&](Trial& trial) {
+        benchOrder(BOUND, order, trial,
+            [] { return new TestObject(); },
+            [](TestObject* t_ptr) { delete t_ptr; });
+    });
+    h.run("LinkedPool", [&](Trial& trial) {
+        benchPool<LinkedPool>(BOUND, order, trial);
+    });
+    h.run("MemoryPool", [&](Trial& trial) {
+        benchPool<MemoryPool>(BOUND, order, trial);
+    });
 #ifdef INCLUDE_BOOST
-    {
-        benchPool<boost::object_pool>(BOUND, j, order, "boost::object_pool");
-    }
+    h.run("boost::object_pool", [&](Trial& trial) {
+        benchBoostPool<boost::object_pool>(BOUND, order, trial);
+    });
 #endif
     return 0;
 }
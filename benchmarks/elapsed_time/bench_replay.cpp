@@ -0,0 +1,439 @@
+/**
+ *  @file bench_replay.cpp
+ *  Replays an allocation trace (see AllocTrace.hpp) with `custom_new` from
+ *  libcustomnew, `GlobalPools`, `MemoryPool` and glibc's malloc.
+ *  @par
+ *  Every thread of the trace is replayed by a thread of its own, which
+ *  makes the (de)allocations of the recorded thread in their order. An
+ *  object that was allocated by another thread is only deallocated once
+ *  that thread has allocated it, so the threads keep the order of the
+ *  trace where it matters, but are not slowed down to its pace.
+ *  @par
+ *  Every allocator replays the trace in a child process of its own, so
+ *  they do not share a heap and the peak resident set size of the child
+ *  can be attributed to the allocator. The peak is measured from the
+ *  resident set size before the allocator was created, so the trace
+ *  itself is not counted.
+ *  @par
+ *  `MemoryPool` only allocates objects of a single type, so sizes up to 256
+ *  bytes are rounded up to a multiple of 16 and served by a pool of their
+ *  own, larger allocations and those aligned at more than 16 bytes are left
+ *  to malloc. The same is done for `GlobalPools` with the sizes above its
+ *  biggest size class. The number of allocations that `MemoryPool` serves
+ *  is written as its `pooled_allocations`.
+ *  @par
+ *  The first command line argument is the trace file.
+ *  @par
+ *  The results will be written to a file called **replay_time_taken.json**,
+ *  whose `replay` entries are the time per (de)allocation.
+ *  @see Harness
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <fstream>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Harness.h"
+#include "GlobalPools.hpp"
+#include "rpools/allocators/MemoryPool.h"
+#include "rpools/custom_new/AllocTrace.hpp"
+
+using rpools::TraceHeader;
+using rpools::TraceRecord;
+using std::vector;
+
+/**
+ *  A (de)allocation of a replaying thread.
+ */
+struct Event {
+    /** The index of the object in the objects of the replay. */
+    size_t object;
+    size_t size;
+    size_t alignment;
+    bool allocate;
+};
+
+/**
+ *  The trace, split up by thread.
+ */
+struct Replay {
+    vector<vector<Event>> threads;
+    size_t numOfObjects = 0;
+    size_t numOfEvents = 0;
+    /** The number of objects that were never deallocated. */
+    size_t leaked = 0;
+};
+
+/**
+ *  Reads the trace at `t_fileName` and numbers its objects, so that an
+ *  object id which is reused by a later allocation becomes a new object.
+ *  Deallocations of unknown objects are dropped.
+ *  @return false if the trace could not be read.
+ */
+bool readReplay(const char* t_fileName, Replay& t_replay) {
+    std::ifstream f(t_fileName, std::ios::binary);
+    TraceHeader header;
+    if (!f.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        header.magic != rpools::TRACE_MAGIC ||
+        header.version != rpools::TRACE_VERSION) {
+        return false;
+    }
+    vector<TraceRecord> records;
+    TraceRecord record;
+    while (f.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+        records.push_back(record);
+    }
+    std::stable_sort(records.begin(), records.end(),
+                     [](const TraceRecord& a, const TraceRecord& b) {
+                         return a.timestamp < b.timestamp;
+                     });
+    std::unordered_map<uint16_t, size_t> threads;
+    // the live objects by id, with the event that allocated them
+    std::unordered_map<uint64_t, Event> live;
+    for (const TraceRecord& r : records) {
+        auto thread = threads.emplace(r.thread, threads.size()).first;
+        if (thread->second == t_replay.threads.size()) {
+            t_replay.threads.emplace_back();
+        }
+        Event event;
+        if (r.op == rpools::TRACE_ALLOCATE) {
+            event = Event{t_replay.numOfObjects++,
+                          std::max<size_t>(1, r.size),
+                          (size_t)1 << r.alignmentLog2, true};
+            live[r.objectId] = event;
+        } else {
+            auto it = live.find(r.objectId);
+            if (it == live.end()) {
+                continue;
+            }
+            event = it->second;
+            event.allocate = false;
+            live.erase(it);
+        }
+        t_replay.threads[thread->second].push_back(event);
+        ++t_replay.numOfEvents;
+    }
+    t_replay.leaked = live.size();
+    return true;
+}
+
+/**
+ *  Rounds `t_size` up to a multiple of `t_alignment`.
+ */
+size_t alignUp(size_t t_size, size_t t_alignment) {
+    return (t_size + t_alignment - 1) & ~(t_alignment - 1);
+}
+
+struct Malloc {
+    void* allocate(size_t t_size, size_t t_alignment) {
+        if (t_alignment <= alignof(max_align_t)) {
+            return malloc(t_size);
+        }
+        return aligned_alloc(t_alignment, alignUp(t_size, t_alignment));
+    }
+
+    void deallocate(void* t_ptr, size_t, size_t) {
+        free(t_ptr);
+    }
+};
+
+/**
+ *  The functions of libcustomnew, which is only loaded by the child process
+ *  that replays with it.
+ */
+void* (*customNew)(size_t, size_t) = nullptr;
+void (*customDelete)(void*) = nullptr;
+
+struct CustomNew {
+    CustomNew() {
+        void* lib = dlopen(CUSTOM_NEW_LIBRARY, RTLD_NOW | RTLD_LOCAL);
+        if (!lib) {
+            std::fprintf(stderr, "%s\n", dlerror());
+            _exit(1);
+        }
+        customNew = reinterpret_cast<void* (*)(size_t, size_t)>(
+            dlsym(lib, "_Z10custom_newmm"));
+        customDelete = reinterpret_cast<void (*)(void*)>(
+            dlsym(lib, "_Z13custom_deletePv"));
+    }
+
+    void* allocate(size_t t_size, size_t t_alignment) {
+        return customNew(t_size, t_alignment);
+    }
+
+    void deallocate(void* t_ptr, size_t, size_t) {
+        customDelete(t_ptr);
+    }
+};
+
+struct Pools {
+    GlobalPools pools;
+    Malloc others;
+
+    void* allocate(size_t t_size, size_t t_alignment) {
+        size_t size = alignUp(t_size, t_alignment);
+        if (size <= pools.getMaxSize() &&
+            t_alignment <= alignof(max_align_t)) {
+            return pools.allocate(size);
+        }
+        return others.allocate(t_size, t_alignment);
+    }
+
+    void deallocate(void* t_ptr, size_t t_size, size_t t_alignment) {
+        size_t size = alignUp(t_size, t_alignment);
+        if (size <= pools.getMaxSize() &&
+            t_alignment <= alignof(max_align_t)) {
+            pools.deallocate(t_ptr, size);
+        } else {
+            others.deallocate(t_ptr, t_size, t_alignment);
+        }
+    }
+};
+
+/**
+ *  The objects of a `MemoryPool`, which are aligned like those of malloc,
+ *  as the trace records plain new and malloc at `alignof(max_align_t)`.
+ */
+template<size_t N>
+struct alignas(alignof(max_align_t)) Bytes {
+    char data[N];
+};
+
+/**
+ *  A `MemoryPool` for every multiple of 16 up to 256 bytes.
+ */
+struct MemoryPools {
+    static const size_t STEP = 16;
+    static const size_t MAX_SIZE = 256;
+
+    /** The pools as their untyped (de)allocation functions. */
+    struct Pool {
+        void* pool;
+        void* (*allocate)(void*);
+        void (*deallocate)(void*, void*);
+        void (*destroy)(void*);
+    };
+
+    vector<Pool> pools;
+    Malloc others;
+
+    MemoryPools() {
+        addPools(std::make_index_sequence<MAX_SIZE / STEP>());
+    }
+
+    ~MemoryPools() {
+        for (Pool& pool : pools) {
+            pool.destroy(pool.pool);
+        }
+    }
+
+    template<size_t... I>
+    void addPools(std::index_sequence<I...>) {
+        (addPool<Bytes<(I + 1) * STEP>>(), ...);
+    }
+
+    template<typename T>
+    void addPool() {
+        pools.push_back(Pool{
+            new MemoryPool<T>(),
+            [](void* p) -> void* {
+                return static_cast<MemoryPool<T>*>(p)->allocate();
+            },
+            [](void* p, void* t_ptr) {
+                static_cast<MemoryPool<T>*>(p)->deallocate(
+                    static_cast<T*>(t_ptr));
+            },
+            [](void* p) { delete static_cast<MemoryPool<T>*>(p); }});
+    }
+
+    /**
+     *  @return whether an object is allocated in one of the pools.
+     */
+    static bool isPooled(size_t t_size, size_t t_alignment) {
+        return t_size <= MAX_SIZE && t_alignment <= alignof(max_align_t);
+    }
+
+    void* allocate(size_t t_size, size_t t_alignment) {
+        if (isPooled(t_size, t_alignment)) {
+            Pool& pool = pools[(t_size - 1) / STEP];
+            return pool.allocate(pool.pool);
+        }
+        return others.allocate(t_size, t_alignment);
+    }
+
+    void deallocate(void* t_ptr, size_t t_size, size_t t_alignment) {
+        if (isPooled(t_size, t_alignment)) {
+            Pool& pool = pools[(t_size - 1) / STEP];
+            pool.deallocate(pool.pool, t_ptr);
+        } else {
+            others.deallocate(t_ptr, t_size, t_alignment);
+        }
+    }
+};
+
+/**
+ *  @return the value of the field `t_field` of /proc/self/status in kB.
+ */
+long readStatus(const char* t_field) {
+    std::ifstream f("/proc/self/status");
+    std::string line;
+    size_t length = std::strlen(t_field);
+    while (std::getline(f, line)) {
+        if (line.compare(0, length, t_field) == 0 && line[length] == ':') {
+            return std::strtol(line.c_str() + length + 1, nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+/**
+ *  The measurements of a replay.
+ */
+struct Result {
+    double nanos;
+    long peakKb;
+};
+
+/**
+ *  Replays `t_replay` with the allocator `A`.
+ *  @return the time the replay took and the growth of the peak resident
+ *          set size.
+ */
+template<typename A>
+Result replay(const Replay& t_replay, const Harness& t_h) {
+    // start measuring the peak from here, which needs Linux 4.0
+    std::ofstream("/proc/self/clear_refs") << "5";
+    long baseKb = readStatus("VmRSS");
+    vector<std::atomic<void*>> objs(t_replay.numOfObjects);
+    A allocator;
+    std::atomic<bool> start(false);
+    double nanos = timeNanos([&] {
+        vector<std::thread> threads;
+        for (size_t t = 0; t < t_replay.threads.size(); ++t) {
+            threads.emplace_back([&, t] {
+                t_h.pinThread(t);
+                while (!start.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+                for (const Event& e : t_replay.threads[t]) {
+                    std::atomic<void*>& obj = objs[e.object];
+                    if (e.allocate) {
+                        obj.store(allocator.allocate(e.size, e.alignment),
+                                  std::memory_order_release);
+                        continue;
+                    }
+                    void* ptr;
+                    while (!(ptr = obj.load(std::memory_order_acquire))) {
+                        std::this_thread::yield();
+                    }
+                    allocator.deallocate(ptr, e.size, e.alignment);
+                }
+            });
+        }
+        start.store(true, std::memory_order_release);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    });
+    return Result{nanos, readStatus("VmHWM") - baseKb};
+}
+
+/**
+ *  Replays `t_replay` with the allocator `A` in a child process.
+ *  @return the result of the child or a negative time if it failed.
+ */
+template<typename A>
+Result replayInChild(const Replay& t_replay, const Harness& t_h) {
+    int fds[2];
+    Result result{-1, 0};
+    if (pipe(fds) != 0) {
+        return result;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        result = replay<A>(t_replay, t_h);
+        ssize_t written = write(fds[1], &result, sizeof(result));
+        _exit(written == sizeof(result) ? 0 : 1);
+    }
+    close(fds[1]);
+    if (pid > 0) {
+        if (read(fds[0], &result, sizeof(result)) != sizeof(result)) {
+            result.nanos = -1;
+        }
+        waitpid(pid, nullptr, 0);
+    }
+    close(fds[0]);
+    return result;
+}
+
+/**
+ *  Replays `t_replay` with the allocator `A` the configured number of
+ *  times and records the time per operation and the peak memory.
+ */
+template<typename A>
+void benchAllocator(const Replay& t_replay, Harness& t_h,
+                    const std::string& t_name) {
+    vector<long> peaks;
+    bool failed = false;
+    vector<double> samples = t_h.repeat([&] {
+        Result result = replayInChild<A>(t_replay, t_h);
+        failed |= result.nanos < 0;
+        peaks.push_back(result.peakKb);
+        return result.nanos / std::max<size_t>(1, t_replay.numOfEvents);
+    });
+    if (failed) {
+        std::fprintf(stderr, "%s failed to replay the trace\n",
+                     t_name.c_str());
+        return;
+    }
+    Summary summary = summarize(samples);
+    auto& entry = t_h.j["allocators"][t_name];
+    entry["replay"] = summary;
+    entry["replay_time"] = summary.median * t_replay.numOfEvents / 1e6;
+    entry["peak_rss_kb"] = *std::max_element(peaks.begin(), peaks.end());
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <trace file>\n", argv[0]);
+        return 1;
+    }
+    Replay replay;
+    if (!readReplay(argv[1], replay)) {
+        std::fprintf(stderr, "%s is not an allocation trace\n", argv[1]);
+        return 1;
+    }
+    Harness h("replay_time_taken.json", replay.numOfObjects);
+    h.j["number_of_events"] = replay.numOfEvents;
+    h.j["number_of_threads"] = replay.threads.size();
+    h.j["leaked_objects"] = replay.leaked;
+    benchAllocator<CustomNew>(replay, h, "custom_new");
+    benchAllocator<Pools>(replay, h, "GlobalPools");
+    // otherwise the MemoryPool results would be the ones of malloc
+    size_t pooled = 0;
+    for (const auto& events : replay.threads) {
+        for (const Event& e : events) {
+            pooled += e.allocate && MemoryPools::isPooled(e.size, e.alignment);
+        }
+    }
+    if (pooled == 0) {
+        std::fprintf(stderr, "no allocation of the trace fits in a "
+                     "MemoryPool\n");
+    }
+    h.j["allocators"]["MemoryPool"]["pooled_allocations"] = pooled;
+    benchAllocator<MemoryPools>(replay, h, "MemoryPool");
+    benchAllocator<Malloc>(replay, h, "malloc");
+    return 0;
+}
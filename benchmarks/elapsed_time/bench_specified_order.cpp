@@ -9,7 +9,7 @@
  *  that will be created and destroyed.
  *  @par
  *  The results will be written to a file called **specified_time_taken.json**.
- *  @see JSONWriter
+ *  @see Harness
  */
 
 #include <vector>
@@ -17,7 +17,7 @@
 #include <random>
 #include <chrono>
 
-#include "Utility.h"
+#include "Harness.h"
 #include "unit_test/TestObject.h"
 #ifdef INCLUDE_BOOST
 #include <boost/pool/object_pool.hpp>
@@ -29,218 +29,115 @@ using rpools::LinkedPool;
 using std::vector;
 
 /**
- *  Allocates `num` `TestObject`s using `new` which are stored in `vec`.
+ *  Allocates `num` `TestObject`s which are stored in `vec`.
  *  @param num the number of objects that are allocated
  *  @param vec the vector in which the allocations are pushed_back
- *  @return The number of ms it took to allocate `num` `TestObject`s.
+ *  @param trial the trial which times the allocations
+ *  @param alloc allocates a `TestObject`
  */
-float allocateN(size_t num, vector<TestObject*>& vec) {
-    std::clock_t start = std::clock();
-    for (size_t i = 0; i < num; ++i) {
-        vec.push_back(new TestObject());
-    }
-    return (std::clock() - start) / (double)(CLOCKS_PER_SEC / 1000);
+template<typename A>
+void allocateN(size_t num, vector<TestObject*>& vec, Trial& trial, A& alloc) {
+    trial.allocate(num, [&](size_t) {
+        vec.push_back(alloc());
+    });
 }
 
 /**
- *  Deallocates `num` `TestObject`s using `delete` which are stored in `vec`.
+ *  Deallocates `num` `TestObject`s which are stored in `vec`.
  *  @param num the number of objects that are deallocated
  *  @param vec the vector from which the deallocated objects are poped_back
- *  @return The number of ms it took to deallocate `num` `TestObject`s.
+ *  @param trial the trial which times the deallocations
+ *  @param dealloc deallocates a `TestObject`
  */
-float deallocateN(size_t num, vector<TestObject*>& vec) {
-    std::clock_t start = std::clock();
-    for (size_t i = 0; i < num; ++i) {
-        delete vec.back();
+template<typename D>
+void deallocateN(size_t num, vector<TestObject*>& vec, Trial& trial,
+                 D& dealloc) {
+    trial.deallocate(num, [&](size_t) {
+        dealloc(vec.back());
         vec.pop_back();
-    }
-    return (std::clock() - start) / (double)(CLOCKS_PER_SEC / 1000);
+    });
 }
 
 /**
- *  Allocates `num` `TestObject`s using a pool allocator which
- *  are stored in `vec`.
- *  @tparam T the type of the pool allocator
- *  @param num the number of objects that are allocated
- *  @param vec the vector in which the allocations are pushed_back
- *  @param lp the pool allocator
- *  @return The number of ms it took to allocate `num` `TestObject`s.
+ *  Allocate and deallocate a number of `TestObject`s in a certain order.
+ *  @param bound the number of (de)allocations
+ *  @param five 5% of `bound`
+ *  @param ten 10% of `bound`
+ *  @param trial the trial which times the (de)allocations
+ *  @param alloc allocates a `TestObject`
+ *  @param dealloc deallocates a `TestObject`
  */
-template<template <typename> class T>
-float allocateN(size_t num, vector<TestObject*>& vec, T<TestObject>& lp) {
-    std::clock_t start = std::clock();
-    for (size_t i = 0; i < num; ++i) {
-        vec.push_back((TestObject*) lp.allocate());
-    }
-    return (std::clock() - start) / (double)(CLOCKS_PER_SEC / 1000);
-}
+template<typename A, typename D>
+void benchOrder(size_t bound, size_t five, size_t ten, Trial& trial,
+                A alloc, D dealloc) {
+    vector<TestObject*> objs;
+    objs.reserve(bound);
 
-/**
- *  Deallocates `num` `TestObject`s using a pool allocator which are stored in
- *  `vec`.
- *  @tparam T the type of the pool allocator
- *  @param num the number of objects that are allocated
- *  @param vec the vector from which the deallocated objects are poped_back
- *  @param lp the pool allocator
- *  @return The number of ms it took to deallocate `num` `TestObject`s.
- */
-template<template <typename> class T>
-float deallocateN(size_t num, vector<TestObject*>& vec, T<TestObject>& lp) {
-    std::clock_t start = std::clock();
-    for (size_t i = 0; i < num; ++i) {
-        lp.deallocate(vec.back());
-        vec.pop_back();
-    }
-    return (std::clock() - start) / (double)(CLOCKS_PER_SEC / 1000);
+    allocateN(ten, objs, trial, alloc);
+    deallocateN(five, objs, trial, dealloc);
+    allocateN(five, objs, trial, alloc);
+    deallocateN(five, objs, trial, dealloc);
+
+    allocateN(ten, objs, trial, alloc);
+    deallocateN(five, objs, trial, dealloc);
+    allocateN(five, objs, trial, alloc);
+    deallocateN(five, objs, trial, dealloc);
+
+    deallocateN(ten, objs, trial, dealloc);
+    allocateN(five, objs, trial, alloc);
+    allocateN(five, objs, trial, alloc);
+    deallocateN(five, objs, trial, dealloc);
+
+    allocateN(five, objs, trial, alloc);
+    deallocateN(five, objs, trial, dealloc);
+    allocateN(five, objs, trial, alloc);
+    deallocateN(ten, objs, trial, dealloc);
 }
 
 /**
  *  Allocate and deallocate a number of `TestObject`s by using a pool allocator
  *  in a certain order.
- *  @note
- *  The allocation and deallocation times are recorded and written to a file.
  *  @tparam T the type of the pool allocator
- *  @param bound the number of (de)allocations
- *  @param j the JSONWriter which records the speed
- *  @param five 5% of `bound`
- *  @param ten 10% of `bound`
- *  @param name the name of the pool allocator which (de)allocates `TestObject`s
+ *  @see benchOrder
  */
 template<template <typename> class T>
-void benchPool(size_t bound, JSONWriter& j,
-               size_t five, size_t ten,
-               const std::string& name) {
+void benchPool(size_t bound, size_t five, size_t ten, Trial& trial) {
     T<TestObject> lp;
-    vector<TestObject*> objs;
-    objs.reserve(bound);
-    float alloc = 0.0f;
-    float dealloc = 0.0f;
-
-    alloc += allocateN(ten, objs, lp);
-    dealloc += deallocateN(five, objs, lp);
-    alloc += allocateN(five, objs, lp);
-    dealloc += deallocateN(five, objs, lp);
-
-    alloc += allocateN(ten, objs, lp);
-    dealloc += deallocateN(five, objs, lp);
-    alloc += allocateN(five, objs, lp);
-    dealloc += deallocateN(five, objs, lp);
-
-    dealloc += deallocateN(ten, objs, lp);
-    alloc += allocateN(five, objs, lp);
-    alloc += allocateN(five, objs, lp);
-    dealloc += deallocateN(five, objs, lp);
-
-    alloc += allocateN(five, objs, lp);
-    dealloc += deallocateN(five, objs, lp);
-    alloc += allocateN(five, objs, lp);
-    dealloc += deallocateN(ten, objs, lp);
-
-    j.addAllocation(name, alloc);
-    j.addDeallocation(name, dealloc);
+    benchOrder(bound, five, ten, trial,
+        [&] { return reinterpret_cast<TestObject*>(lp.allocate()); },
+        [&](TestObject* t_ptr) { lp.deallocate(t_ptr); });
 }
 
 #ifdef INCLUDE_BOOST
 template<template <typename, typename> class T>
-float allocateN(size_t num, vector<TestObject*>& vec,
-                T<TestObject, boost::default_user_allocator_malloc_free>& lp) {
-    std::clock_t start = std::clock();
-    for (size_t i = 0; i < num; ++i) {
-        vec.push_back((TestObject*) lp.malloc());
-    }
-    return (std::clock() - start) / (double)(CLOCKS_PER_SEC / 1000);
-}
-
-template<template <typename, typename> class T>
-float deallocateN(size_t num, vector<TestObject*>& vec,
-                  T<TestObject, boost::default_user_allocator_malloc_free>& lp) {
-    std::clock_t start = std::clock();
-    for (size_t i = 0; i < num; ++i) {
-        lp.free(vec.back());
-        vec.pop_back();
-    }
-    return (std::clock() - start) / (double)(CLOCKS_PER_SEC / 1000);
-}
-
-template<template <typename, typename> class T>
-void benchPool(size_t BOUND, JSONWriter& j,
-               size_t five, size_t ten,
-               const std::string& name) {
+void benchBoostPool(size_t bound, size_t five, size_t ten, Trial& trial) {
     T<TestObject, boost::default_user_allocator_malloc_free> lp;
-    vector<TestObject*> objs;
-
-    float alloc = 0.0f;
-    float dealloc = 0.0f;
-
-    alloc += allocateN(ten, objs, lp);
-    dealloc += deallocateN(five, objs, lp);
-    alloc += allocateN(five, objs, lp);
-    dealloc += deallocateN(five, objs, lp);
-
-    alloc += allocateN(ten, objs, lp);
-    dealloc += deallocateN(five, objs, lp);
-    alloc += allocateN(five, objs, lp);
-    dealloc += deallocateN(five, objs, lp);
-
-    dealloc += deallocateN(ten, objs, lp);
-    alloc += allocateN(five, objs, lp);
-    alloc += allocateN(five, objs, lp);
-    dealloc += deallocateN(five, objs, lp);
-
-    alloc += allocateN(five, objs, lp);
-    dealloc += deallocateN(five, objs, lp);
-    alloc += allocateN(five, objs, lp);
-    dealloc += deallocateN(ten, objs, lp);
-
-    j.addAllocation(name, alloc);
-    j.addDeallocation(name, dealloc);
+    benchOrder(bound, five, ten, trial,
+        [&] { return reinterpret_cast<TestObject*>(lp.malloc()); },
+        [&](TestObject* t_ptr) { lp.free(t_ptr); });
 }
 #endif
 
 int main(int argc, char *argv[]) {
     size_t BOUND = argc > 1 ? std::stoul(argv[1]) : 10000;
-    JSONWriter j("specified_time_taken.json", BOUND);
+    Harness h("specified_time_taken.json", BOUND);
     size_t five = BOUND * 5 / 100; // 5%
     size_t ten = BOUND / 10; // 10%
-    {
-        vector<TestObject*> objs;
-        objs.reserve(BOUND);
-        float alloc = 0.0f;
-        float dealloc = 0.0f;
-
-        alloc += allocateN(ten, objs);
-        dealloc += deallocateN(five, objs);
-        alloc += allocateN(five, objs);
-        dealloc += deallocateN(five, objs);
-
-        alloc += allocateN(ten, objs);
-        dealloc += deallocateN(five, objs);
-        alloc += allocateN(five, objs);
-        dealloc += deallocateN(five, objs);
-
-        dealloc += deallocateN(ten, objs);
-        alloc += allocateN(five, objs);
-        alloc += allocateN(five, objs);
-        dealloc += deallocateN(five, objs);
-
-        alloc += allocateN(five, objs);
-        dealloc += deallocateN(five, objs);
-        alloc += allocateN(five, objs);
-        dealloc += deallocateN(ten, objs);
-
-        j.addAllocation("new/delete", alloc);
-        j.addDeallocation("new/delete", dealloc);
-    }
-    {
-        benchPool<LinkedPool>(BOUND, j, five, ten, "LinkedPool");
-    }
-    {
-        benchPool<MemoryPool>(BOUND, j, five, ten, "MemoryPool");
-    }
+    h.run("new/delete", [&](Trial& trial) {
+        benchOrder(BOUND, five, ten, trial,
+            [] { return new TestObject(); },
+            [](TestObject* t_ptr) { delete t_ptr; });
+    });
+    h.run("LinkedPool", [&](Trial& trial) {
+        benchPool<LinkedPool>(BOUND, five, ten, trial);
+    });
+    h.run("MemoryPool", [&](Trial& trial) {
+        benchPool<MemoryPool>(BOUND, five, ten, trial);
+    });
 #ifdef INCLUDE_BOOST
-    {
-        benchPool<boost::object_pool>(BOUND, j, five, ten, "boost::object_pool");
-    }
+    h.run("boost::object_pool", [&](Trial& trial) {
+        benchBoostPool<boost::object_pool>(BOUND, five, ten, trial);
+    });
 #endif
     return 0;
 }
@@ -0,0 +1,357 @@
+/**
+ *  @file bench_threads.cpp
+ *  Measures how the allocators scale with the number of threads, running
+ *  1, 2, 4, ... threads up to the given maximum in three scenarios:
+ *  - **local**: every thread allocates a number of objects and then
+ *    deallocates them itself.
+ *  - **cross**: the threads are paired up, one thread of every pair
+ *    allocates the objects and hands them over to the other one which
+ *    deallocates them (producer/consumer).
+ *  - **mixed**: every thread allocates objects of three size classes and
+ *    keeps the last `WINDOW` of them alive, deallocating the oldest one
+ *    for every new allocation.
+ *
+ *  The allocators are `LinkedPool`, `GlobalLinkedPool`, `custom_new` from
+ *  libcustomnew and `new/delete`. libcustomnew is loaded with `dlopen`,
+ *  because linking it would also replace the `operator new` that this
+ *  benchmark compares it with.
+ *  @par
+ *  The first command line argument sets the number of objects per thread
+ *  and the second one the maximum number of threads (default: the number
+ *  of CPUs).
+ *  @par
+ *  The results will be written to a file called **threads_time_taken.json**
+ *  in this form:
+ *  ```
+ *   {
+ *       "number_of_allocations": 100000,
+ *       "number_of_threads": 4,
+ *       "scenarios": {
+ *           "local": {
+ *               "threads": [1, 2, 4],
+ *               "allocators": {
+ *                   "LinkedPool": {
+ *                       "ops_per_sec": [41235612.0, 30123451.0, 2901234.0],
+ *                       "ops_per_sec_stddev": [212931.0, 502113.0, 81234.0]
+ *                   },
+ *                   ...
+ *               }
+ *           },
+ *           ...
+ *       }
+ *   }
+ *  ```
+ *  Every allocation and every deallocation counts as one operation, the
+ *  times are wall-clock and every point is the median of the trials of the
+ *  harness (see `plot_scalability.py`).
+ *  @see Harness
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <dlfcn.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Harness.h"
+#include "rpools/allocators/GlobalLinkedPool.hpp"
+#include "rpools/allocators/LinkedPool.hpp"
+#include "rpools/tools/CacheAligned.hpp"
+
+using rpools::CacheAligned;
+using rpools::GlobalLinkedPool;
+using rpools::LinkedPool;
+
+/** The sizes of the objects of the three size classes. */
+constexpr size_t SIZES[] = {16, 64, 256};
+constexpr size_t NUM_SIZES = sizeof(SIZES) / sizeof(SIZES[0]);
+/** The number of objects a thread keeps alive in the mixed scenario. */
+const size_t WINDOW = 256;
+
+template<size_t N>
+struct Bytes {
+    char data[N];
+};
+
+/**
+ *  Allocates the size classes from three `LinkedPool`s.
+ */
+struct LinkedPools {
+    LinkedPool<Bytes<SIZES[0]>> small;
+    LinkedPool<Bytes<SIZES[1]>> medium;
+    LinkedPool<Bytes<SIZES[2]>> large;
+
+    void* allocate(size_t t_class) {
+        switch (t_class) {
+            case 0: return small.allocate();
+            case 1: return medium.allocate();
+            default: return large.allocate();
+        }
+    }
+
+    void deallocate(void* t_ptr, size_t t_class) {
+        switch (t_class) {
+            case 0: small.deallocate(t_ptr); break;
+            case 1: medium.deallocate(t_ptr); break;
+            default: large.deallocate(t_ptr);
+        }
+    }
+};
+
+/**
+ *  Allocates the size classes from three `GlobalLinkedPool`s, laid out
+ *  like the pools of `GlobalPools`.
+ */
+struct GlobalLinkedPools {
+    CacheAligned<GlobalLinkedPool> pools[NUM_SIZES] = {
+        CacheAligned<GlobalLinkedPool>(SIZES[0]),
+        CacheAligned<GlobalLinkedPool>(SIZES[1]),
+        CacheAligned<GlobalLinkedPool>(SIZES[2])
+    };
+
+    void* allocate(size_t t_class) {
+        return pools[t_class].value.allocate();
+    }
+
+    void deallocate(void* t_ptr, size_t t_class) {
+        pools[t_class].value.deallocate(t_ptr);
+    }
+};
+
+/**
+ *  The functions of libcustomnew, which are looked up once by `main`.
+ */
+void* (*customNew)(size_t, size_t) = nullptr;
+void (*customDelete)(void*) = nullptr;
+
+struct CustomNew {
+    void* allocate(size_t t_class) {
+        return customNew(SIZES[t_class], alignof(max_align_t));
+    }
+
+    void deallocate(void* t_ptr, size_t) {
+        customDelete(t_ptr);
+    }
+};
+
+struct NewDelete {
+    void* allocate(size_t t_class) {
+        return ::operator new(SIZES[t_class]);
+    }
+
+    void deallocate(void* t_ptr, size_t) {
+        ::operator delete(t_ptr);
+    }
+};
+
+/**
+ *  A bounded single-producer single-consumer queue which hands the
+ *  objects of a producer over to its consumer.
+ */
+class Handoff {
+public:
+    void push(void* t_ptr) {
+        size_t tail = m_tail.value.load(std::memory_order_relaxed);
+        while (tail - m_head.value.load(std::memory_order_acquire) ==
+               CAPACITY) {
+            std::this_thread::yield();
+        }
+        m_slots[tail % CAPACITY] = t_ptr;
+        m_tail.value.store(tail + 1, std::memory_order_release);
+    }
+
+    void* pop() {
+        size_t head = m_head.value.load(std::memory_order_relaxed);
+        while (m_tail.value.load(std::memory_order_acquire) == head) {
+            std::this_thread::yield();
+        }
+        void* ptr = m_slots[head % CAPACITY];
+        m_head.value.store(head + 1, std::memory_order_release);
+        return ptr;
+    }
+
+private:
+    static const size_t CAPACITY = 1024;
+
+    CacheAligned<std::atomic<size_t>> m_head{0};
+    CacheAligned<std::atomic<size_t>> m_tail{0};
+    void* m_slots[CAPACITY];
+};
+
+/**
+ *  Runs `t_work(thread)` on `t_threads` threads, every thread pinned by
+ *  `t_h` if it is configured to.
+ *  @return the wall-clock time it took in seconds.
+ */
+template<typename F>
+double timeThreads(const Harness& t_h, size_t t_threads, F t_work) {
+    return timeNanos([&] {
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < t_threads; ++t) {
+            threads.emplace_back([&t_h, &t_work, t] {
+                t_h.pinThread(t);
+                t_work(t);
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }) / 1e9;
+}
+
+/**
+ *  @return the operations per second of `t_threads` threads which
+ *          allocate `t_bound` objects and then deallocate them.
+ */
+template<typename A>
+double benchLocal(const Harness& t_h, size_t t_bound, size_t t_threads) {
+    A allocator;
+    std::vector<std::vector<void*>> objs(t_threads,
+                                         std::vector<void*>(t_bound));
+    double seconds = timeThreads(t_h, t_threads, [&](size_t t) {
+        for (size_t i = 0; i < t_bound; ++i) {
+            objs[t][i] = allocator.allocate(0);
+        }
+        for (size_t i = 0; i < t_bound; ++i) {
+            allocator.deallocate(objs[t][i], 0);
+        }
+    });
+    return 2 * t_bound * t_threads / seconds;
+}
+
+/**
+ *  @return the operations per second of `t_threads / 2` producers which
+ *          allocate `t_bound` objects each and hand them over to their
+ *          consumer which deallocates them.
+ */
+template<typename A>
+double benchCross(const Harness& t_h, size_t t_bound, size_t t_threads) {
+    A allocator;
+    size_t pairs = t_threads / 2;
+    std::vector<Handoff> handoffs(pairs);
+    double seconds = timeThreads(t_h, 2 * pairs, [&](size_t t) {
+        Handoff& handoff = handoffs[t / 2];
+        if (t % 2 == 0) {
+            for (size_t i = 0; i < t_bound; ++i) {
+                handoff.push(allocator.allocate(0));
+            }
+        } else {
+            for (size_t i = 0; i < t_bound; ++i) {
+                allocator.deallocate(handoff.pop(), 0);
+            }
+        }
+    });
+    return 2 * t_bound * pairs / seconds;
+}
+
+/**
+ *  @return the operations per second of `t_threads` threads which
+ *          allocate `t_bound` objects of all size classes, keeping the
+ *          last `WINDOW` of them alive.
+ */
+template<typename A>
+double benchMixed(const Harness& t_h, size_t t_bound, size_t t_threads) {
+    A allocator;
+    double seconds = timeThreads(t_h, t_threads, [&](size_t t) {
+        void* live[WINDOW] = {};
+        size_t classes[WINDOW] = {};
+        // a different pattern of size classes for every thread
+        size_t state = t * 2654435761u + 1;
+        for (size_t i = 0; i < t_bound; ++i) {
+            size_t k = i % WINDOW;
+            if (live[k]) {
+                allocator.deallocate(live[k], classes[k]);
+            }
+            state = state * 6364136223846793005u + 1442695040888963407u;
+            classes[k] = (state >> 33) % NUM_SIZES;
+            live[k] = allocator.allocate(classes[k]);
+        }
+        for (size_t k = 0; k < WINDOW; ++k) {
+            if (live[k]) {
+                allocator.deallocate(live[k], classes[k]);
+            }
+        }
+    });
+    return 2 * t_bound * t_threads / seconds;
+}
+
+/** A scenario for one of the allocators. */
+using Bench = double (*)(const Harness&, size_t, size_t);
+
+/**
+ *  Runs one scenario for every allocator and number of threads.
+ *  @param t_bench the scenario, for each of the allocators
+ *  @param t_threads the numbers of threads
+ */
+void benchScenario(Harness& t_h, const std::string& t_scenario,
+                   const std::vector<size_t>& t_threads,
+                   const Bench t_bench[4], size_t t_bound) {
+    const char* names[] = {"LinkedPool", "GlobalLinkedPool", "custom_new",
+                           "new/delete"};
+    auto& scenario = t_h.j["scenarios"][t_scenario];
+    scenario["threads"] = t_threads;
+    for (size_t a = 0; a < 4; ++a) {
+        if (a == 2 && !customNew) {
+            continue;
+        }
+        std::vector<double> opsPerSec;
+        std::vector<double> stddevs;
+        for (size_t threads : t_threads) {
+            Summary summary = summarize(t_h.repeat([&] {
+                return t_bench[a](t_h, t_bound, threads);
+            }));
+            opsPerSec.push_back(summary.median);
+            stddevs.push_back(summary.stddev);
+        }
+        auto& allocator = scenario["allocators"][names[a]];
+        allocator["ops_per_sec"] = opsPerSec;
+        allocator["ops_per_sec_stddev"] = stddevs;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    size_t BOUND = argc > 1 ? std::stoul(argv[1]) : 100000;
+    size_t THREADS = argc > 2 ? std::stoul(argv[2]) :
+        std::max(2u, std::thread::hardware_concurrency());
+    void* customNewLib = dlopen(CUSTOM_NEW_LIBRARY, RTLD_NOW | RTLD_LOCAL);
+    if (customNewLib) {
+        customNew = reinterpret_cast<void* (*)(size_t, size_t)>(
+            dlsym(customNewLib, "_Z10custom_newmm"));
+        customDelete = reinterpret_cast<void (*)(void*)>(
+            dlsym(customNewLib, "_Z13custom_deletePv"));
+    }
+    if (!customNew || !customDelete) {
+        customNew = nullptr;
+        std::fprintf(stderr, "custom_new is skipped: %s\n", dlerror());
+    }
+    std::vector<size_t> threads;
+    std::vector<size_t> pairedThreads;
+    for (size_t t = 1; t < THREADS; t *= 2) {
+        threads.push_back(t);
+    }
+    threads.push_back(THREADS);
+    for (size_t t : threads) {
+        if (t >= 2 && (pairedThreads.empty() ||
+                       t / 2 * 2 != pairedThreads.back())) {
+            pairedThreads.push_back(t / 2 * 2);
+        }
+    }
+
+    Harness h("threads_time_taken.json", BOUND);
+    h.j["number_of_threads"] = THREADS;
+    const Bench local[4] = {
+        benchLocal<LinkedPools>, benchLocal<GlobalLinkedPools>,
+        benchLocal<CustomNew>, benchLocal<NewDelete>};
+    const Bench cross[4] = {
+        benchCross<LinkedPools>, benchCross<GlobalLinkedPools>,
+        benchCross<CustomNew>, benchCross<NewDelete>};
+    const Bench mixed[4] = {
+        benchMixed<LinkedPools>, benchMixed<GlobalLinkedPools>,
+        benchMixed<CustomNew>, benchMixed<NewDelete>};
+    benchScenario(h, "local", threads, local, BOUND);
+    benchScenario(h, "cross", pairedThreads, cross, BOUND);
+    benchScenario(h, "mixed", threads, mixed, BOUND);
+    return 0;
+}
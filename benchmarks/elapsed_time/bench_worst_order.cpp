@@ -9,11 +9,12 @@
  *  that will be created and destroyed.
  *  @par
  *  The results will be written to a file called **worst_time_taken.json**.
+ *  @see Harness
  */
 
 #include <vector>
 
-#include "Utility.h"
+#include "Harness.h"
 #include "unit_test/TestObject.h"
 #ifdef INCLUDE_BOOST
 #include <boost/pool/object_pool.hpp>
@@ -24,6 +25,23 @@
 using rpools::LinkedPool;
 using std::vector;
 
+/**
+ *  @return the objects of `objs` in the order in which they are deallocated:
+ *          the i-th slot of every subpool of size `poolSize` for all
+ *          i = [0, poolSize).
+ */
+vector<TestObject*> worstOrder(const vector<TestObject*>& objs,
+                               size_t poolSize, size_t mult) {
+    vector<TestObject*> order;
+    order.reserve(objs.size());
+    for (size_t i = 0; i < poolSize; ++i) {
+        for (size_t offset = 0; offset < mult; ++offset) {
+            order.push_back(objs[i + offset * poolSize]);
+        }
+    }
+    return order;
+}
+
 /**
  *  Allocate and deallocate **poolSize * mult** of `TestObject`s
  *  by using a pool allocator.
@@ -32,56 +50,40 @@ using std::vector;
  *  @par
  *  The reason why this is slow for `LinkedPool` is because it will potentially
  *  generate lots of page faults.
- *  @note
- *  The allocation and deallocation times are recorded and written to a file.
  *  @tparam T the type of the pool allocator
  *  @param bound the number of (de)allocations
- *  @param f the file in which the output is written
  *  @param poolSize the size of a subpool of `LinkedPool`
  *  @param mult a value which is multiplied with `poolSize`
- *  @param name the name of the pool allocator which (de)allocates `TestObject`s
+ *  @param trial the trial which times the (de)allocations
  *  @see LinkedPool
  *  @see TestObject
  */
 template<template <typename> class T>
-void benchPool(size_t bound, JSONWriter& j, size_t poolSize,
-               size_t mult, const std::string& name) {
+void benchPool(size_t bound, size_t poolSize, size_t mult, Trial& trial) {
     T<TestObject> lp;
     vector<TestObject*> objs(bound);
-    std::clock_t start = std::clock();
-    for (size_t i = 0; i < bound; ++i) {
+    trial.allocate(bound, [&](size_t i) {
         objs[i] = reinterpret_cast<TestObject*>(lp.allocate());
-    }
-    j.addAllocation(name, start);
-
-    start = std::clock();
-    for (size_t i = 0; i < poolSize; ++i) {
-        for (size_t offset = 0; offset < mult; ++offset) {
-            lp.deallocate(objs[i + offset * poolSize]);
-        }
-    }
-    j.addDeallocation(name, start);
+    });
+    objs = worstOrder(objs, poolSize, mult);
+    trial.deallocate(bound, [&](size_t i) {
+        lp.deallocate(objs[i]);
+    });
 }
 
 #ifdef INCLUDE_BOOST
 template<template <typename, typename> class T>
-void benchPool(size_t bound, JSONWriter& j, size_t poolSize,
-               size_t mult, const std::string& name) {
+void benchBoostPool(size_t bound, size_t poolSize, size_t mult,
+                    Trial& trial) {
     T<TestObject, boost::default_user_allocator_malloc_free> lp;
     vector<TestObject*> objs(bound);
-    std::clock_t start = std::clock();
-    for (size_t i = 0; i < bound; ++i) {
+    trial.allocate(bound, [&](size_t i) {
         objs[i] = reinterpret_cast<TestObject*>(lp.malloc());
-    }
-    j.addAllocation(name, start);
-
-    start = std::clock();
-    for (size_t i = 0; i < poolSize; ++i) {
-        for (size_t offset = 0; offset < mult; ++offset) {
-            lp.free(objs[i + offset * poolSize]);
-        }
-    }
-    j.addDeallocation(name, start);
+    });
+    objs = worstOrder(objs, poolSize, mult);
+    trial.deallocate(bound, [&](size_t i) {
+        lp.free(objs[i]);
+    });
 }
 #endif
 
@@ -90,32 +92,26 @@ int main(int argc, char* argv[]) {
     // every type of linked pool will provide the same pool size
     size_t POOL_SIZE = LinkedPool<TestObject>().getPoolSize();
     size_t BOUND = POOL_SIZE * MULT;
-    JSONWriter j("worst_time_taken.json", BOUND);
-    {
+    Harness h("worst_time_taken.json", BOUND);
+    h.run("new/delete", [&](Trial& trial) {
         vector<TestObject*> objs(BOUND);
-        std::clock_t start = std::clock();
-        for (size_t i = 0; i < BOUND; ++i) {
+        trial.allocate(BOUND, [&](size_t i) {
             objs[i] = new TestObject();
-        }
-        j.addAllocation("new/delete", start);
-
-        start = std::clock();
-        for (size_t i = 0; i < POOL_SIZE; ++i) {
-            for (size_t offset = 0; offset < MULT; ++offset) {
-                delete (objs[i + offset * POOL_SIZE]);
-            }
-        }
-        j.addDeallocation("new/delete", start);
-    }
-    {
-        benchPool<LinkedPool>(BOUND, j, POOL_SIZE, MULT, "LinkedPool");
-    }
-    {
-        benchPool<MemoryPool>(BOUND, j, POOL_SIZE, MULT, "MemoryPool");
-    }
+        });
+        objs = worstOrder(objs, POOL_SIZE, MULT);
+        trial.deallocate(BOUND, [&](size_t i) {
+            delete objs[i];
+        });
+    });
+    h.run("LinkedPool", [&](Trial& trial) {
+        benchPool<LinkedPool>(BOUND, POOL_SIZE, MULT, trial);
+    });
+    h.run("MemoryPool", [&](Trial& trial) {
+        benchPool<MemoryPool>(BOUND, POOL_SIZE, MULT, trial);
+    });
 #ifdef INCLUDE_BOOST
-    {
-        benchPool<boost::object_pool>(BOUND, j, POOL_SIZE, MULT, "boost::object_pool");
-    }
+    h.run("boost::object_pool", [&](Trial& trial) {
+        benchBoostPool<boost::object_pool>(BOUND, POOL_SIZE, MULT, trial);
+    });
 #endif
 }
@@ -0,0 +1,132 @@
+#ifndef __EMPTY_POOL_CACHE_H__
+#define __EMPTY_POOL_CACHE_H__
+
+#include <cstddef>
+
+#include "rpools/allocators/PoolIndex.hpp"
+#include "rpools/tools/PageProvider.hpp"
+
+namespace rpools {
+
+/**
+ *  Keeps a bounded number of empty pools around instead of giving them back
+ *  to the system immediately, so that an allocator which oscillates around a
+ *  pool boundary does not allocate and free a pool every time.
+ *  @par
+ *  The cache decays: every `DECAY_PERIOD` pushes and pops, half of the pools
+ *  that stayed in the cache for the whole period are freed.
+ *  @warning an `EmptyPoolCache` is not thread safe.
+ */
+class EmptyPoolCache {
+public:
+    /** The default maximum number of empty pools that are cached. */
+    static const size_t DEFAULT_LIMIT = 1;
+    /** The number of pushes and pops after which the cache decays. */
+    static const size_t DECAY_PERIOD = 256;
+
+    /**
+     *  @param t_limit the maximum number of empty pools that are cached
+     */
+    explicit EmptyPoolCache(size_t t_limit=DEFAULT_LIMIT)
+        : m_limit(t_limit) {
+
+    }
+
+    /**
+     *  @return an empty pool of the cache or nullptr if the cache is empty.
+     */
+    Pool pop() {
+        Pool pool = m_head;
+        if (pool) {
+            m_head = getLinks(pool)->next;
+            --m_size;
+        }
+        decay();
+        return pool;
+    }
+
+    /**
+     *  Caches an empty pool, or frees it if the cache is full.
+     *  @param t_pool a pool which has no occupied slots
+     */
+    void push(Pool t_pool) {
+        if (m_size >= m_limit) {
+            deallocatePool(t_pool);
+        } else {
+            getLinks(t_pool)->next = m_head;
+            m_head = t_pool;
+            ++m_size;
+        }
+        decay();
+    }
+
+    /**
+     *  Frees all the cached pools.
+     */
+    void trim() { release(m_size); }
+
+    /**
+     *  Changes the maximum number of empty pools that are cached and frees
+     *  the pools that do not fit anymore.
+     *  @param t_limit the new limit
+     */
+    void setLimit(size_t t_limit) {
+        m_limit = t_limit;
+        if (m_size > m_limit) {
+            release(m_size - m_limit);
+        }
+    }
+
+    /**
+     *  @return the maximum number of empty pools that are cached.
+     */
+    size_t getLimit() const { return m_limit; }
+
+    /**
+     *  @return the number of empty pools that are cached.
+     */
+    size_t size() const { return m_size; }
+
+private:
+    Pool m_head = nullptr;
+    size_t m_size = 0;
+    size_t m_limit;
+    /** The number of pushes and pops since the last decay. */
+    size_t m_events = 0;
+    /** The minimum size of the cache since the last decay. */
+    size_t m_lowWater = 0;
+
+    /**
+     *  Frees half of the pools that were not needed during the last
+     *  `DECAY_PERIOD` pushes and pops.
+     */
+    void decay() {
+        if (m_size < m_lowWater) {
+            m_lowWater = m_size;
+        }
+        if (++m_events == DECAY_PERIOD) {
+            release((m_lowWater + 1) / 2);
+            m_events = 0;
+            m_lowWater = m_size;
+        }
+    }
+
+    /**
+     *  Frees `t_n` of the cached pools.
+     */
+    void release(size_t t_n) {
+        for (; t_n > 0 && m_head; --t_n) {
+            Pool pool = m_head;
+            m_head = getLinks(pool)->next;
+            --m_size;
+            deallocatePool(pool);
+        }
+    }
+
+    static PoolLinks* getLinks(Pool t_pool) {
+        return static_cast<PoolLinks*>(t_pool);
+    }
+};
+}
+
+#endif // __EMPTY_POOL_CACHE_H__
@@ -1,12 +1,15 @@
 #ifndef __GLOBAL_LINKED_POOL_H__
 #define __GLOBAL_LINKED_POOL_H__
 
-extern "C" {
-#include "rpools/avltree/avl_utils.h"
-}
+#include <atomic>
+
+#include "rpools/allocators/EmptyPoolCache.hpp"
 #include "rpools/allocators/PoolHeaderG.hpp"
 #include "rpools/tools/LMLock.hpp"
 #include "rpools/tools/pool_utils.hpp"
+#ifdef RPOOLS_NUMA
+#include "rpools/tools/Numa.hpp"
+#endif
 
 namespace rpools {
 
@@ -20,7 +23,16 @@ using Pool = void*;
  *  @par
  *  A `GlobalLinkedPool` does not know the type of object, but will be able
  *  to allocate objects that have the same size.
- *  @note When all objects of a page are deallocated, the page is freed.
+ *  @note When all objects of a page are deallocated, the page is freed,
+ *        unless it is kept in the cache of empty pools (see `trim`).
+ *  @par
+ *  A deallocation which finds the pool lock taken by another thread does
+ *  not wait for it. The slot is pushed onto a lock-free list of remote
+ *  frees instead, which is drained by the thread that holds the lock.
+ *  @par
+ *  When `RPOOLS_NUMA` is defined, the pools of every NUMA node are indexed
+ *  and cached separately and a thread allocates from the pools of the node
+ *  it runs on, whose memory is bound to that node (see `allocatePool`).
  */
 class GlobalLinkedPool {
 public:
@@ -36,11 +48,23 @@ public:
     GlobalLinkedPool(size_t t_sizeOfObjects=sizeof(Node),
                      size_t t_alignment=alignof(max_align_t));
 
+    /**
+     *  Takes over the pools of `other`.
+     *  @warning `other` must not be used concurrently.
+     */
+    GlobalLinkedPool(GlobalLinkedPool&& other);
+
+    /**
+     *  Frees the cached empty pools.
+     */
+    virtual ~GlobalLinkedPool();
+
     /**
      *  Allocates space for an object of size N in one of the free slots
      *  and returns a pointer the memory location of where the object will be
      *  stored.
-     *  @return A pointer to one of the free slots.
+     *  @return A pointer to one of the free slots or nullptr if there is
+     *          no memory left.
      */
     void* allocate();
 
@@ -52,15 +76,72 @@ public:
     void deallocate(void* t_ptr);
 
     /**
-     *  @return the number of slots that fit in a page of memory.
+     *  Allocates `t_n` slots while taking the pool lock only once.
+     *  @param t_out the array in which the pointers to the slots are stored
+     *  @param t_n the number of slots to allocate
+     *  @return the number of slots that were allocated.
+     */
+    size_t allocateBulk(void** t_out, size_t t_n);
+
+    /**
+     *  Deallocates `t_n` slots while taking the pool lock only once.
+     *  The slots are grouped by their pool, and the slots of a pool are
+     *  returned to it together (see `releaseByPool`).
+     *  @param t_ptrs the array of pointers that will be deallocated, which
+     *                may be reordered
+     *  @param t_n the number of pointers in `t_ptrs`
+     */
+    void deallocateBulk(void** t_ptrs, size_t t_n);
+
+    /**
+     *  Frees all the empty pools that are cached.
+     */
+    void trim();
+
+    /**
+     *  Changes the maximum number of empty pools that are kept around
+     *  instead of being freed (default: `EmptyPoolCache::DEFAULT_LIMIT`).
+     *  @note With `RPOOLS_NUMA` the limit applies to every NUMA slot (see
+     *        `getNumaSlot`), so up to `MAX_NUMA_SLOTS` times as many empty
+     *        pools may be cached in total.
+     *  @param t_limit the maximum number of cached empty pools per NUMA node
+     */
+    void setEmptyPoolLimit(size_t t_limit);
+
+    /**
+     *  @return the number of empty pools that are cached.
+     */
+    size_t getNumberOfEmptyPools() const;
+
+    /**
+     *  @return the number of slots that fit in a pool (see `getPoolSpan`).
      */
     size_t getPoolSize() const { return m_poolSize; }
 
     /**
      *  @warning this is not a constant time operation so use it wisely!
-     *  @return the number of pages that are currently allocated
+     *  @return the number of pools that are neither full nor empty, which
+     *          are indexed as having free slots; full pools and the cached
+     *          empty pools (see `getNumberOfEmptyPools`) are not counted.
+     */
+    size_t getNumberOfPools() const;
+
+    /**
+     *  @return the counters of the pool lock (see `RPOOLS_LOCK_STATS`).
+     */
+    LockStats getLockStats() const { return m_poolLock.getStats(); }
+
+    /**
+     *  Takes the pool lock before the process forks, so that the child
+     *  does not inherit it held by a thread that the child does not have.
+     */
+    void lockForFork() { m_poolLock.lock(); }
+
+    /**
+     *  Releases the lock taken by `lockForFork`, in the parent and in the
+     *  child.
      */
-    size_t getNumberOfPools() const { return pool_count(&m_freePools); }
+    void unlockAfterFork() { unlock(); }
 
     /**
      *  @param t_ptr the pointer of a slot of the pool
@@ -69,21 +150,98 @@ public:
     static const PoolHeaderG& getPoolHeader(void* t_ptr);
 
 private:
-    avl_tree m_freePools;
+    // the lock comes first so that it shares its cache line with the index
+    // that it guards (see CacheAligned.hpp)
     LMLock m_poolLock;
+#ifdef RPOOLS_NUMA
+    static const size_t NUM_NODE_SLOTS = MAX_NUMA_SLOTS;
+#else
+    static const size_t NUM_NODE_SLOTS = 1;
+#endif
+
+    /** The pools of a NUMA node (or of all nodes without `RPOOLS_NUMA`). */
+    struct NodePools {
+        PoolIndex freePools;
+        EmptyPoolCache emptyPools;
+    };
+
+    NodePools m_nodes[NUM_NODE_SLOTS];
     const size_t m_sizeOfObjects;
     size_t m_headerPadding = 0;
     size_t m_slotSize;
     size_t m_poolSize = 0;
-    Pool m_freePool = nullptr;
+    /** Slots deallocated while another thread held the pool lock. */
+    std::atomic<Node*> m_remoteFrees;
 
     /** @see LinkedPool3::constructPoolHeader */
     void constructPoolHeader(char* t_ptr);
 
+    /**
+     *  @return the pools of the NUMA node that the calling thread runs on.
+     */
+    NodePools& getNodePools();
+
+    /**
+     *  @return the pools of the NUMA node which `t_pool` belongs to.
+     */
+    NodePools& getNodePools(Pool t_pool);
+
+    /**
+     *  @return a pool which has at least one free slot. A new pool is
+     *          created if all the other pools are full, nullptr is returned
+     *          if that fails.
+     *  @note The pool lock must be held by the caller.
+     */
+    Pool getFreePool();
+
     /**
      *  @return a pointer to the next free slot of memory from the given Pool.
+     *  @note The pool lock must be held by the caller.
      */
     void* nextFree(Pool t_ptr);
+
+    /**
+     *  Takes up to `t_n` free slots from the given Pool.
+     *  @return the number of slots that were stored in `t_out`.
+     *  @note The pool lock must be held by the caller.
+     */
+    size_t nextFree(Pool t_pool, void** t_out, size_t t_n);
+
+    /**
+     *  Returns the slot at `t_ptr` to its pool.
+     *  @note The pool lock must be held by the caller.
+     */
+    void release(void* t_ptr);
+
+    /**
+     *  Returns `t_n` slots which belong to the same pool to it.
+     *  @note The pool lock must be held by the caller.
+     */
+    void release(void** t_ptrs, size_t t_n);
+
+    /**
+     *  Returns `t_n` slots to their pools, one pool at a time.
+     *  @note The pool lock must be held by the caller.
+     */
+    void releaseBulk(void** t_ptrs, size_t t_n);
+
+    /**
+     *  Pushes the list of slots `t_first -> ... -> t_last` onto the remote
+     *  frees with a single CAS and drains them if the lock is free.
+     */
+    void pushRemoteFrees(Node* t_first, Node* t_last);
+
+    /**
+     *  Releases all the slots that were deallocated remotely.
+     *  @note The pool lock must be held by the caller.
+     */
+    void drainRemoteFrees();
+
+    /**
+     *  Releases the pool lock and drains the remote frees that were pushed
+     *  while it was held.
+     */
+    void unlock();
 };
 }
 #endif // __GLOBAL_LINKED_POOL_H__
@@ -1,32 +1,37 @@
 #ifndef __LINKED_POOL_H__
 #define __LINKED_POOL_H__
 
+#include <algorithm>
 #include <cstdlib>
 #include <new>
 
+#include "rpools/allocators/EmptyPoolCache.hpp"
 #include "rpools/allocators/Node.hpp"
+#include "rpools/allocators/PoolIndex.hpp"
 #include "rpools/tools/LMLock.hpp"
+#include "rpools/tools/PageProvider.hpp"
 #include "rpools/tools/pool_utils.hpp"
 
-extern "C" {
-#include "rpools/avltree/avl_utils.h"
-}
-
 namespace rpools {
 
 using Pool = void*;
 
 /**
- *  Every pool is allocated on a page boundary.
- *  The `PoolHeader` is placed at the first byte of the page and
+ *  Every pool is allocated on a `getPoolSpan()` boundary (a page by default).
+ *  The `PoolHeader` is placed at the first byte of the pool and
  *  contains certain metadata about a pool.
  */
 struct PoolHeader {
+    /** Links the pool into the `PoolIndex` of pools with free slots. */
+    PoolLinks links;
     /** Denotes the number of slots that are occupied. */
     size_t occupiedSlots;
-    /** A `Node` which points to the next free slot of the pool, or
-     *  to nullptr if there are no slots left. */
+    /** A `Node` which points to the next deallocated slot of the pool,
+     *  or to nullptr if no slot was deallocated. */
     Node head;
+    /** The first slot that was never allocated. Slots are carved from
+     *  the unused tail of the pool only when the free list is empty. */
+    char* unusedTail;
 };
 
 /**
@@ -34,7 +39,8 @@ struct PoolHeader {
  *  overheads of small objects.
  *  This is done by allocating a number of pages of memory in which objects
  *  will be allocated.
- *  @note When all objects of a page are deallocated, the page is freed.
+ *  @note When all objects of a page are deallocated, the page is freed,
+ *        unless it is kept in the cache of empty pools (see `trim`).
  *  @tparam T the type of object to store in the pool
  */
 template<typename T>
@@ -47,6 +53,11 @@ public:
      */
     LinkedPool();
 
+    /**
+     *  Frees the cached empty pools.
+     */
+    virtual ~LinkedPool();
+
     /**
      *  Allocates space for an object of type T in one of the free slots
      *  and returns a pointer the mmeory location of where the object will be
@@ -63,23 +74,65 @@ public:
     void deallocate(void* t_ptr);
 
     /**
-     *  @return the number of T objects that fit in a page of memory.
+     *  Allocates `t_n` slots while taking the pool lock only once.
+     *  @param t_out the array in which the pointers to the slots are stored
+     *  @param t_n the number of slots to allocate
+     *  @return the number of slots that were allocated.
+     */
+    size_t allocateBulk(void** t_out, size_t t_n);
+
+    /**
+     *  Deallocates `t_n` slots while taking the pool lock only once.
+     *  The slots are grouped by their pool, and the slots of a pool are
+     *  returned to it together (see `releaseByPool`).
+     *  @param t_ptrs the array of pointers that will be deallocated, which
+     *                may be reordered
+     *  @param t_n the number of pointers in `t_ptrs`
+     */
+    void deallocateBulk(void** t_ptrs, size_t t_n);
+
+    /**
+     *  Frees all the empty pools that are cached.
+     */
+    void trim();
+
+    /**
+     *  Changes the maximum number of empty pools that are kept around
+     *  instead of being freed (default: `EmptyPoolCache::DEFAULT_LIMIT`).
+     *  @param t_limit the maximum number of cached empty pools
+     */
+    void setEmptyPoolLimit(size_t t_limit);
+
+    /**
+     *  @return the number of empty pools that are cached.
+     */
+    size_t getNumberOfEmptyPools() const { return m_emptyPools.size(); }
+
+    /**
+     *  @return the number of T objects that fit in a pool (see `getPoolSpan`).
      */
     size_t getPoolSize() { return m_poolSize; }
 
     /**
      *  @warning this is not a constant time operation so use it wisely!
-     *  @return the number of pages that are currently allocated
+     *  @return the number of pools that are neither full nor empty, which
+     *          are indexed as having free slots; full pools and the cached
+     *          empty pools (see `getNumberOfEmptyPools`) are not counted.
+     */
+    size_t getNumberOfPools() { return m_freePools.count(); }
+
+    /**
+     *  @return the counters of the pool lock (see `RPOOLS_LOCK_STATS`).
      */
-    size_t getNumberOfPools() { return pool_count(&m_freePools); }
+    LockStats getLockStats() const { return m_poolLock.getStats(); }
 
 private:
-    avl_tree m_freePools;
+    PoolIndex m_freePools;
+    EmptyPoolCache m_emptyPools;
     LMLock m_poolLock;
     size_t m_headerPadding = 0;
     size_t m_slotSize;
     size_t m_poolSize = 0;
-    Pool m_freePool = nullptr;
 
     /**
      *  Creates a `PoolHeader` at **t_ptr**
@@ -88,14 +141,31 @@ private:
     void constructPoolHeader(Pool t_ptr);
 
     /**
-     *  @return a pointer to the next free slot of memory from the given `Pool`.
+     *  @return a pool which has at least one free slot. A new pool is
+     *          created if all the other pools are full, nullptr is returned
+     *          if that fails.
+     *  @note The pool lock must be held by the caller.
+     */
+    Pool getFreePool();
+
+    /**
+     *  Takes up to `t_n` free slots from the given `Pool`.
+     *  @return the number of slots that were stored in `t_out`.
+     *  @note The pool lock must be held by the caller.
      */
-    void* nextFree(Pool t_ptr);
+    size_t nextFree(Pool t_ptr, void** t_out, size_t t_n);
+
+    /**
+     *  Returns `t_n` slots which belong to the same pool to it.
+     *  @note The pool lock must be held by the caller.
+     */
+    void release(void** t_ptrs, size_t t_n);
 };
 
 template<typename T>
 LinkedPool<T>::LinkedPool()
     : m_freePools(),
+      m_emptyPools(),
       m_poolLock(),
       m_slotSize(sizeof(T) < sizeof(Node) ? sizeof(Node) : sizeof(T)) {
     // make sure the first slot starts at a proper alignment
@@ -108,91 +178,160 @@ LinkedPool<T>::LinkedPool()
     if (diff != 0) {
         m_slotSize += alignof(T) - diff;
     }
-    m_poolSize = (getPageSize() - sizeof(PoolHeader)) / m_slotSize;
+    m_poolSize = (getPoolSpan() - sizeof(PoolHeader) - m_headerPadding) /
+        m_slotSize;
+    m_freePools = PoolIndex(m_poolSize);
+}
+
+template<typename T>
+LinkedPool<T>::~LinkedPool() {
+    m_emptyPools.trim();
+}
+
+template<typename T>
+void LinkedPool<T>::trim() {
+    m_poolLock.lock();
+    m_emptyPools.trim();
+    m_poolLock.unlock();
+}
+
+template<typename T>
+void LinkedPool<T>::setEmptyPoolLimit(size_t t_limit) {
+    m_poolLock.lock();
+    m_emptyPools.setLimit(t_limit);
+    m_poolLock.unlock();
 }
 
 template<typename T>
 void* LinkedPool<T>::allocate() {
+    void* toReturn = nullptr;
     m_poolLock.lock();
-    // use the cached pool to get the next slot
-    if (m_freePool) {
-        return nextFree(m_freePool);
-    } else {
-        // look for a page that has a free slot
-        Pool pool = pool_first(&m_freePools);
-        if (pool) {
-            // a page has a free slot
-            return nextFree(pool);
-        } else {
-            // allocate a new page of memory because there are no free pool
-            // slots left
-            Pool pool = aligned_alloc(getPageSize(), getPageSize());
-            constructPoolHeader(pool);
-            pool_insert(&m_freePools, pool);
-            m_freePool = pool;
-            return nextFree(pool);
-        }
+    Pool pool = getFreePool();
+    if (pool) {
+        nextFree(pool, &toReturn, 1);
     }
+    m_poolLock.unlock();
+    return toReturn;
 }
 
 template<typename T>
 void LinkedPool<T>::deallocate(void* t_ptr) {
-    // get the pool of t_ptr
+    m_poolLock.lock();
+    release(&t_ptr, 1);
+    m_poolLock.unlock();
+}
+
+template<typename T>
+size_t LinkedPool<T>::allocateBulk(void** t_out, size_t t_n) {
+    size_t allocated = 0;
+    m_poolLock.lock();
+    while (allocated < t_n) {
+        Pool pool = getFreePool();
+        if (!pool) {
+            break;
+        }
+        allocated += nextFree(pool, t_out + allocated, t_n - allocated);
+    }
+    m_poolLock.unlock();
+    return allocated;
+}
+
+template<typename T>
+void LinkedPool<T>::deallocateBulk(void** t_ptrs, size_t t_n) {
+    m_poolLock.lock();
+    releaseByPool(t_ptrs, t_n, [this](void** t_slots, size_t t_count) {
+        release(t_slots, t_count);
+    });
+    m_poolLock.unlock();
+}
+
+template<typename T>
+Pool LinkedPool<T>::getFreePool() {
+    // look for the fullest page that has a free slot, so that the
+    // sparse pages are given a chance to become empty
+    Pool pool = m_freePools.first();
+    if (!pool) {
+        // reuse an empty page or allocate a new page of memory because
+        // there are no free pool slots left
+        pool = m_emptyPools.pop();
+        if (!pool) {
+            pool = allocatePool();
+        }
+        if (!pool) {
+            return nullptr;
+        }
+        constructPoolHeader(pool);
+        m_freePools.insert(pool, 0);
+    }
+    return pool;
+}
+
+template<typename T>
+void LinkedPool<T>::release(void** t_ptrs, size_t t_n) {
+    // get the pool of the slots
     auto pool = reinterpret_cast<PoolHeader*>(
-        reinterpret_cast<size_t>(t_ptr) & getPoolMask()
+        reinterpret_cast<size_t>(t_ptrs[0]) & getPoolMask()
     );
-    m_poolLock.lock();
-    // the last slot was deallocated => free the page
-    if (pool->occupiedSlots == 1) {
-        pool_remove(&m_freePools, pool);
-        free(pool);
-        m_freePool = pool_first(&m_freePools);
-    } else {
-        auto newNodeG = new (t_ptr) Node();
-        // update nodes to point to the newly create Node
-        Node& head = pool->head;
+    size_t oldOccupied = pool->occupiedSlots;
+    // the last slots were deallocated => cache or free the page
+    if (oldOccupied == t_n) {
+        // a full pool is not in the index
+        if (oldOccupied < m_poolSize) {
+            m_freePools.remove(pool, oldOccupied);
+        }
+        m_emptyPools.push(pool);
+        return;
+    }
+    // update nodes to point to the newly created Nodes
+    Node& head = pool->head;
+    for (size_t i = 0; i < t_n; ++i) {
+        auto newNodeG = new (t_ptrs[i]) Node();
         newNodeG->next = head.next;
         head.next = newNodeG;
-        m_freePool = pool;
-        // the pool is not full, therefore add it to the list of pools
-        // that have free slots
-        if (--pool->occupiedSlots == m_poolSize - 1) {
-            pool_insert(&m_freePools, pool);
-        }
     }
-    m_poolLock.unlock();
+    size_t occupied = pool->occupiedSlots -= t_n;
+    // the pool is not full anymore, therefore add it to the list of pools
+    // that have free slots
+    if (oldOccupied == m_poolSize) {
+        m_freePools.insert(pool, occupied);
+    } else {
+        m_freePools.update(pool, oldOccupied, occupied);
+    }
 }
 
 template<typename T>
 void LinkedPool<T>::constructPoolHeader(Pool t_ptr) {
     auto header = new (t_ptr) PoolHeader();
     auto first = reinterpret_cast<char*>(header + 1);
-    first += m_headerPadding;
-    header->head.next = reinterpret_cast<Node*>(first);
-    for (size_t i = 0; i < m_poolSize - 1; ++i) {
-        auto node = new (first) Node();
-        first += m_slotSize;
-        node->next = reinterpret_cast<Node*>(first);
-    }
-    new (first) Node();
+    // the slots are only touched once they are allocated
+    header->unusedTail = first + m_headerPadding;
 }
 
 template<typename T>
-void* LinkedPool<T>::nextFree(Pool t_ptr) {
+size_t LinkedPool<T>::nextFree(Pool t_ptr, void** t_out, size_t t_n) {
     auto header = reinterpret_cast<PoolHeader*>(t_ptr);
+    size_t oldOccupied = header->occupiedSlots;
+    size_t n = std::min(t_n, m_poolSize - oldOccupied);
     Node& head = header->head;
-    void* toReturn = head.next;
-    if (head.next) {
-        head.next = head.next->next;
-        // if the pool becomes full, don't consider it in the list
-        // of pools that have some free slots
-        if (++(header->occupiedSlots) == m_poolSize) {
-            pool_remove(&m_freePools, t_ptr);
-            m_freePool = pool_first(&m_freePools);
+    for (size_t i = 0; i < n; ++i) {
+        if (head.next) {
+            t_out[i] = head.next;
+            head.next = head.next->next;
+        } else {
+            // the pool is not full, so the free slots are in the unused tail
+            t_out[i] = header->unusedTail;
+            header->unusedTail += m_slotSize;
         }
     }
-    m_poolLock.unlock();
-    return toReturn;
+    size_t occupied = header->occupiedSlots += n;
+    // if the pool becomes full, don't consider it in the list
+    // of pools that have some free slots
+    if (occupied == m_poolSize) {
+        m_freePools.remove(t_ptr, oldOccupied);
+    } else {
+        m_freePools.update(t_ptr, oldOccupied, occupied);
+    }
+    return n;
 }
 
 }
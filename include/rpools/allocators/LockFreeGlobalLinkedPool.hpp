@@ -0,0 +1,174 @@
+#ifndef __LOCK_FREE_GLOBAL_LINKED_POOL_H__
+#define __LOCK_FREE_GLOBAL_LINKED_POOL_H__
+
+#include <atomic>
+
+#include "rpools/allocators/EmptyPoolCache.hpp"
+#include "rpools/allocators/LockFreePoolHeader.hpp"
+#include "rpools/tools/LMLock.hpp"
+#include "rpools/tools/pool_utils.hpp"
+
+namespace rpools {
+
+using Pool = void*;
+
+/**
+ *  A version of `GlobalLinkedPool` whose slots are allocated and
+ *  deallocated without taking the pool lock.
+ *  @par
+ *  The free slots of every pool are a lock-free stack (see
+ *  `LockFreePoolHeader`). Allocations pop from the current pool and
+ *  deallocations push onto the pool of the slot, so the pool lock is only
+ *  taken when a pool changes membership in the free-pool index: when the
+ *  current pool runs out of slots, when a full pool gets a free slot and
+ *  when a pool becomes empty.
+ *  @par
+ *  An allocation may still be using a pool after it stopped being the
+ *  current one, so the allocations announce themselves in one of two
+ *  epochs and an empty pool is only released once the allocations of both
+ *  epochs have finished (see `synchronize`).
+ *  @note Unlike `GlobalLinkedPool`, the slots of a new pool are linked when
+ *        the pool is created, and the pools of the index are binned by the
+ *        occupancy they were indexed with, as lock-free deallocations do
+ *        not move them between bins.
+ */
+class LockFreeGlobalLinkedPool {
+public:
+    /** @see GlobalLinkedPool::GlobalLinkedPool */
+    LockFreeGlobalLinkedPool(size_t t_sizeOfObjects=sizeof(Node),
+                             size_t t_alignment=alignof(max_align_t));
+
+    /**
+     *  Takes over the pools of `other`.
+     *  @warning `other` must not be used concurrently.
+     */
+    LockFreeGlobalLinkedPool(LockFreeGlobalLinkedPool&& other);
+
+    /**
+     *  Frees the cached empty pools.
+     */
+    virtual ~LockFreeGlobalLinkedPool();
+
+    /** @see GlobalLinkedPool::allocate */
+    void* allocate();
+
+    /** @see GlobalLinkedPool::deallocate */
+    void deallocate(void* t_ptr);
+
+    /**
+     *  Allocates `t_n` slots.
+     *  @return the number of slots that were allocated.
+     */
+    size_t allocateBulk(void** t_out, size_t t_n);
+
+    /**
+     *  Deallocates `t_n` slots, which are grouped by their pool (and may
+     *  be reordered), so that the slots of a pool are pushed onto it with
+     *  a single CAS (see `releaseByPool`).
+     */
+    void deallocateBulk(void** t_ptrs, size_t t_n);
+
+    /** @see GlobalLinkedPool::trim */
+    void trim();
+
+    /** @see GlobalLinkedPool::setEmptyPoolLimit */
+    void setEmptyPoolLimit(size_t t_limit);
+
+    size_t getNumberOfEmptyPools() const { return m_emptyPools.size(); }
+
+    size_t getPoolSize() const { return m_poolSize; }
+
+    /**
+     *  @warning this is not a constant time operation so use it wisely!
+     *  @return the number of pools that have free slots, including the
+     *          current one.
+     */
+    size_t getNumberOfPools() const {
+        return m_freePools.count() + (m_current.load() ? 1 : 0);
+    }
+
+    /**
+     *  @return the counters of the pool lock, which is only taken when
+     *          a pool changes membership in the index.
+     */
+    LockStats getLockStats() const { return m_poolLock.getStats(); }
+
+    /**
+     *  @param t_ptr the pointer of a slot of the pool
+     *  @return the `LockFreePoolHeader` at **t_ptr & PAGE_MASK**.
+     */
+    static const LockFreePoolHeader& getPoolHeader(void* t_ptr);
+
+private:
+    using Header = LockFreePoolHeader;
+
+    PoolIndex m_freePools;
+    EmptyPoolCache m_emptyPools;
+    LMLock m_poolLock;
+    const size_t m_sizeOfObjects;
+    size_t m_headerPadding = 0;
+    size_t m_slotSize;
+    size_t m_poolSize = 0;
+    /** The pool that lock-free allocations pop from or nullptr. */
+    std::atomic<Header*> m_current;
+    /** The epoch that new allocations announce themselves in. */
+    std::atomic<size_t> m_epoch;
+    /** The number of lock-free allocations running in every epoch. */
+    std::atomic<size_t> m_allocators[2];
+
+    /** @see LinkedPool3::constructPoolHeader */
+    void constructPoolHeader(char* t_ptr);
+
+    /**
+     *  Allocates a slot while holding the pool lock, replacing the current
+     *  pool if it is full.
+     */
+    void* allocateLocked();
+
+    /**
+     *  @return a pool of the index, an empty pool or a new pool which is
+     *          removed from the index, nullptr if that fails.
+     *  @note The pool lock must be held by the caller.
+     */
+    Header* getFreePool();
+
+    /**
+     *  Pops a free slot of `t_pool` and counts it as occupied.
+     *  @return the slot or nullptr if the pool had no free slots.
+     */
+    static void* pop(Header* t_pool);
+
+    /**
+     *  Returns `t_n` slots which belong to the same pool to it.
+     */
+    void release(void** t_ptrs, size_t t_n);
+
+    /**
+     *  Uncounts `t_n` slots that were pushed onto `t_pool` and puts the
+     *  pool back in the index if it was detached.
+     *  @note The pool lock must be held by the caller.
+     */
+    void releaseLocked(Header* t_pool, size_t t_n);
+
+    /**
+     *  Takes an empty pool out of the index (or stops it from being the
+     *  current pool) and caches it once no allocation can be using it.
+     *  @note The pool lock must be held by the caller.
+     */
+    void releaseEmpty(Header* t_pool);
+
+    /**
+     *  Adds `t_pool` to the index with `t_occupied` slots.
+     *  @note The pool lock must be held by the caller.
+     */
+    void index(Header* t_pool, size_t t_occupied);
+
+    /**
+     *  Waits until all the lock-free allocations which might have seen
+     *  a pool that is not current anymore have finished.
+     *  @note The pool lock must be held by the caller.
+     */
+    void synchronize();
+};
+}
+#endif // __LOCK_FREE_GLOBAL_LINKED_POOL_H__
@@ -0,0 +1,79 @@
+#ifndef __LOCK_FREE_POOL_HEADER__
+#define __LOCK_FREE_POOL_HEADER__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "rpools/allocators/Node.hpp"
+#include "rpools/allocators/PoolIndex.hpp"
+
+namespace rpools {
+
+/**
+ *  The header of a pool of `LockFreeGlobalLinkedPool`, which is placed at
+ *  the first byte of the pool like `PoolHeaderG`.
+ *  @par
+ *  The free slots form a Treiber stack: `freeList` packs the offset of the
+ *  top slot from the header in its low 32 bits and a tag which is bumped by
+ *  every push and pop in its high 32 bits, so that a pop which read a stale
+ *  top fails its CAS (ABA).
+ */
+struct LockFreePoolHeader {
+    /** Where a pool is with respect to the index of its allocator. */
+    enum State : uint32_t {
+        /** The pool lock-free allocations are served from. */
+        CURRENT,
+        /** The pool is in the index of pools with free slots. */
+        INDEXED,
+        /** The pool is full and it is not part of the index. */
+        DETACHED
+    };
+
+    /** Links the pool into the `PoolIndex` of pools with free slots. */
+    PoolLinks links;
+    /** The size of a pool slot. */
+    size_t sizeOfSlot;
+    /** The number of occupied slots the pool was indexed with. */
+    size_t indexedOccupancy;
+    /** Changed only while the pool lock is held. */
+    std::atomic<State> state;
+    /** Denotes the number of slots that are occupied. */
+    std::atomic<size_t> occupiedSlots;
+    /** The tagged top of the stack of free slots. */
+    std::atomic<uint64_t> freeList;
+
+    /**
+     *  Create a `LockFreePoolHeader` whose slots are all free.
+     *  @param t_sizeOfSlot the size of a slot in the pool
+     *  @param t_firstSlot the first pool slot, the others are linked
+     *                     after it by the caller
+     */
+    LockFreePoolHeader(size_t t_sizeOfSlot, char* t_firstSlot)
+        : links(), sizeOfSlot(t_sizeOfSlot), indexedOccupancy(0),
+          state(DETACHED), occupiedSlots(0),
+          freeList(toOffset(t_firstSlot)) {
+
+    }
+
+    /**
+     *  @return the offset of `t_node` from the header, 0 for nullptr.
+     */
+    uint64_t toOffset(const void* t_node) const {
+        return t_node ? static_cast<const char*>(t_node) -
+            reinterpret_cast<const char*>(this) : 0;
+    }
+
+    /**
+     *  @return the slot at the offset which is packed in `t_freeList`.
+     */
+    Node* toNode(uint64_t t_freeList) const {
+        uint32_t offset = static_cast<uint32_t>(t_freeList);
+        return offset ? reinterpret_cast<Node*>(
+            const_cast<char*>(reinterpret_cast<const char*>(this)) + offset
+        ) : nullptr;
+    }
+};
+}
+
+#endif // __LOCK_FREE_POOL_HEADER__
@@ -1,13 +1,10 @@
 #ifndef __NS_GLOBAL_LINKED_POOL_H__
 #define __NS_GLOBAL_LINKED_POOL_H__
 
+#include "rpools/allocators/EmptyPoolCache.hpp"
 #include "rpools/allocators/PoolHeaderG.hpp"
 #include "rpools/tools/pool_utils.hpp"
 
-extern "C" {
-#include "rpools/avltree/avl_utils.h"
-}
-
 namespace rpools {
 
 using Pool = void*;
@@ -21,22 +18,31 @@ public:
     NSGlobalLinkedPool(size_t t_sizeOfObjects=sizeof(Node),
                        size_t alignment=alignof(max_align_t));
 
+    virtual ~NSGlobalLinkedPool();
+
     void* allocate();
     void deallocate(void* t_ptr);
+    size_t allocateBulk(void** t_out, size_t t_n);
+    void deallocateBulk(void** t_ptrs, size_t t_n);
+    void trim();
+    void setEmptyPoolLimit(size_t t_limit);
+    size_t getNumberOfEmptyPools() const { return m_emptyPools.size(); }
     size_t getPoolSize() const { return m_poolSize; }
-    size_t getNumberOfPools() const { return pool_count(&m_freePools); }
+    size_t getNumberOfPools() const { return m_freePools.count(); }
     static const PoolHeaderG& getPoolHeader(void* t_ptr);
 
 private:
-    avl_tree m_freePools;
+    PoolIndex m_freePools;
+    EmptyPoolCache m_emptyPools;
     const size_t m_sizeOfObjects;
     size_t m_headerPadding = 0;
     size_t m_slotSize;
     size_t m_poolSize = 0;
-    Pool m_freePool = nullptr;
 
+    Pool getFreePool();
     void constructPoolHeader(char* t_ptr);
-    void* nextFree(Pool t_ptr);
+    size_t nextFree(Pool t_pool, void** t_out, size_t t_n);
+    void release(void** t_ptrs, size_t t_n);
 };
 }
 
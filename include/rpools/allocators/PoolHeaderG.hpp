@@ -3,37 +3,49 @@
 
 #include <cstddef>
 #include "rpools/allocators/Node.hpp"
+#include "rpools/allocators/PoolIndex.hpp"
 
 namespace rpools {
 
 /**
- *  Every pool is allocated on a page boundary.
- *  The `PoolHeaderG` is placed at the first byte of the page and
+ *  Every pool is allocated on a `getPoolSpan()` boundary (a page by default).
+ *  The `PoolHeaderG` is placed at the first byte of the pool and
  *  contains certain metadata about a pool.
  */
 struct PoolHeaderG {
+    /** Links the pool into the `PoolIndex` of pools with free slots. */
+    PoolLinks links;
     /** Denotes the number of slots that are occupied. */
     size_t occupiedSlots;
     /** The size of a pool slot. */
     size_t sizeOfSlot;
-     /** A `Node` which points to the next free slot of the pool, or
-      *  to nullptr if there are no slots left. */
+     /** A `Node` which points to the next deallocated slot of the pool,
+      *  or to nullptr if no slot was deallocated. */
     Node head;
+    /** The first slot that was never allocated. Slots are carved from
+     *  the unused tail of the pool only when the free list is empty. */
+    char* unusedTail;
+#ifdef RPOOLS_NUMA
+    /** The NUMA slot of the indexes which hold the pool (see Numa.hpp). */
+    size_t numaSlot = 0;
+#endif
 
     /**
      *  Create a `PoolHeaderG` with non-default values.
      *  @param t_sizeOfSlot the size of a slot in the pool
-     *  @param t_next the first empty pool slot
+     *  @param t_unusedTail the first pool slot
      */
-    PoolHeaderG(size_t t_sizeOfSlot, Node* t_next)
-        : occupiedSlots(0), sizeOfSlot(t_sizeOfSlot), head(t_next) {
+    PoolHeaderG(size_t t_sizeOfSlot, char* t_unusedTail)
+        : links(), occupiedSlots(0), sizeOfSlot(t_sizeOfSlot), head(),
+          unusedTail(t_unusedTail) {
 
     }
 
     bool operator ==(const PoolHeaderG& other) const {
         return occupiedSlots == other.occupiedSlots &&
             sizeOfSlot == other.sizeOfSlot &&
-            head.next == other.head.next;
+            head.next == other.head.next &&
+            unusedTail == other.unusedTail;
     }
 };
 }
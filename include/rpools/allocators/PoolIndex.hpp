@@ -0,0 +1,184 @@
+#ifndef __POOL_INDEX_H__
+#define __POOL_INDEX_H__
+
+#include <cstddef>
+
+#ifdef RPOOLS_AVL_FREE_POOLS
+extern "C" {
+#include "rpools/avltree/avl_utils.h"
+}
+#endif
+
+namespace rpools {
+
+using Pool = void*;
+
+/**
+ *  The links which are used to keep a pool in a `PoolIndex`.
+ *  Every pool header starts with a `PoolLinks` so that a `Pool` can be
+ *  linked into an index without allocating any memory.
+ */
+struct PoolLinks {
+    /** The previous pool of the index or nullptr. */
+    Pool prev;
+    /** The next pool of the index or nullptr. */
+    Pool next;
+};
+
+/**
+ *  Keeps track of the pools which have free slots.
+ *  @par
+ *  The pools are split into `NUM_BINS` bins according to the number of
+ *  occupied slots they have and `first` returns a pool from the fullest
+ *  non-empty bin. Allocating from the fullest pools lets the sparse ones
+ *  drain, so that they can be freed.
+ *  @par
+ *  Every bin is an intrusive doubly linked list which is threaded through
+ *  the `PoolLinks` of the pool headers, therefore every operation except
+ *  `count` is constant time and no memory is allocated.
+ *  @par
+ *  If `RPOOLS_AVL_FREE_POOLS` is defined, the pools are kept in an AVL tree
+ *  instead (see avl_utils.h) and the occupancy of a pool is ignored.
+ *  @warning a pool must start with a `PoolLinks` and it can be part of
+ *           at most one `PoolIndex`.
+ */
+class PoolIndex {
+public:
+    /** The number of occupancy bins. */
+    static const size_t NUM_BINS = 8;
+
+    /**
+     *  @param t_poolSize the number of slots of a pool
+     */
+    explicit PoolIndex(size_t t_poolSize=NUM_BINS)
+        : m_poolSize(t_poolSize == 0 ? 1 : t_poolSize) {
+#ifdef RPOOLS_AVL_FREE_POOLS
+        avl_init(&m_tree, nullptr);
+#endif
+    }
+
+    /**
+     *  Adds a pool that is not part of the index.
+     *  @param t_pool the pool that is added
+     *  @param t_occupied the number of occupied slots of the pool
+     */
+    void insert(Pool t_pool, size_t t_occupied) {
+#ifdef RPOOLS_AVL_FREE_POOLS
+        (void)t_occupied;
+        pool_insert(&m_tree, t_pool);
+#else
+        size_t bin = getBin(t_occupied);
+        PoolLinks* links = getLinks(t_pool);
+        links->prev = nullptr;
+        links->next = m_bins[bin];
+        if (m_bins[bin]) {
+            getLinks(m_bins[bin])->prev = t_pool;
+        }
+        m_bins[bin] = t_pool;
+        m_nonEmptyBins |= 1u << bin;
+#endif
+    }
+
+    /**
+     *  Removes a pool that is part of the index.
+     *  @param t_pool the pool that is removed
+     *  @param t_occupied the number of occupied slots the pool had when it
+     *                    was last inserted or updated
+     */
+    void remove(Pool t_pool, size_t t_occupied) {
+#ifdef RPOOLS_AVL_FREE_POOLS
+        (void)t_occupied;
+        pool_remove(&m_tree, t_pool);
+#else
+        size_t bin = getBin(t_occupied);
+        PoolLinks* links = getLinks(t_pool);
+        if (links->prev) {
+            getLinks(links->prev)->next = links->next;
+        } else {
+            m_bins[bin] = links->next;
+            if (!m_bins[bin]) {
+                m_nonEmptyBins &= ~(1u << bin);
+            }
+        }
+        if (links->next) {
+            getLinks(links->next)->prev = links->prev;
+        }
+#endif
+    }
+
+    /**
+     *  Moves a pool of the index to the bin of its new occupancy.
+     *  @param t_pool the pool whose number of occupied slots changed
+     *  @param t_oldOccupied the previous number of occupied slots
+     *  @param t_newOccupied the current number of occupied slots
+     */
+    void update(Pool t_pool, size_t t_oldOccupied, size_t t_newOccupied) {
+#ifdef RPOOLS_AVL_FREE_POOLS
+        (void)t_pool;
+        (void)t_oldOccupied;
+        (void)t_newOccupied;
+#else
+        if (getBin(t_oldOccupied) != getBin(t_newOccupied)) {
+            remove(t_pool, t_oldOccupied);
+            insert(t_pool, t_newOccupied);
+        }
+#endif
+    }
+
+    /**
+     *  @return one of the fullest pools of the index or nullptr if the index
+     *          is empty.
+     */
+    Pool first() {
+#ifdef RPOOLS_AVL_FREE_POOLS
+        return pool_first(&m_tree);
+#else
+        if (m_nonEmptyBins == 0) {
+            return nullptr;
+        }
+        // the highest non-empty bin holds the fullest pools
+        return m_bins[31 - __builtin_clz(m_nonEmptyBins)];
+#endif
+    }
+
+    /**
+     *  @warning this is not a constant time operation so use it wisely!
+     *  @return the number of pools in the index.
+     */
+    size_t count() const {
+#ifdef RPOOLS_AVL_FREE_POOLS
+        return pool_count(&m_tree);
+#else
+        size_t count = 0;
+        for (size_t bin = 0; bin < NUM_BINS; ++bin) {
+            for (Pool pool = m_bins[bin]; pool; pool = getLinks(pool)->next) {
+                ++count;
+            }
+        }
+        return count;
+#endif
+    }
+
+private:
+    size_t m_poolSize;
+#ifdef RPOOLS_AVL_FREE_POOLS
+    avl_tree m_tree;
+#else
+    Pool m_bins[NUM_BINS] = {};
+    unsigned int m_nonEmptyBins = 0;
+
+    /**
+     *  @return the bin of a pool which has `t_occupied` occupied slots.
+     */
+    size_t getBin(size_t t_occupied) const {
+        return t_occupied * NUM_BINS / m_poolSize;
+    }
+
+    static PoolLinks* getLinks(Pool t_pool) {
+        return static_cast<PoolLinks*>(t_pool);
+    }
+#endif
+};
+}
+
+#endif // __POOL_INDEX_H__
@@ -0,0 +1,80 @@
+#ifndef __SLOT_CACHE_H__
+#define __SLOT_CACHE_H__
+
+#include <cstddef>
+
+#include "rpools/allocators/GlobalLinkedPool.hpp"
+
+namespace rpools {
+
+/**
+ *  Represents a small stack of free slots (a magazine) which sits in front
+ *  of a `GlobalLinkedPool` and is owned by a single thread.
+ *  @par
+ *  Slots are taken from the pool `REFILL_SIZE` at a time and given back
+ *  `REFILL_SIZE` at a time when the cache is full, therefore the pool lock
+ *  is only taken once for every batch of (de)allocations.
+ *  @par
+ *  A `SlotCache` has no constructor so that it can be zero-initialised
+ *  in thread local storage.
+ *  @warning a `SlotCache` is not thread safe.
+ */
+class SlotCache {
+public:
+    /** The maximum number of slots that are cached. */
+    static const size_t CAPACITY = 32;
+    /** The number of slots that are moved between the cache and the pool. */
+    static const size_t REFILL_SIZE = CAPACITY / 2;
+
+    /**
+     *  @param t_pool the pool which is used when the cache is empty
+     *  @return a pointer to a free slot of `t_pool`.
+     */
+    void* allocate(GlobalLinkedPool& t_pool) {
+        if (m_count == 0 && refill(t_pool) == 0) {
+            return nullptr;
+        }
+        return m_slots[--m_count];
+    }
+
+    /**
+     *  Caches the given slot.
+     *  @param t_pool the pool which receives slots when the cache is full
+     *  @param t_ptr the slot that is deallocated
+     */
+    void deallocate(GlobalLinkedPool& t_pool, void* t_ptr) {
+        if (m_count == CAPACITY) {
+            flush(t_pool, REFILL_SIZE);
+        }
+        m_slots[m_count++] = t_ptr;
+    }
+
+    /**
+     *  Returns all the cached slots to the pool.
+     *  @param t_pool the pool from which the slots were allocated
+     */
+    void flush(GlobalLinkedPool& t_pool) { flush(t_pool, m_count); }
+
+    /**
+     *  @return the number of slots that are currently cached.
+     */
+    size_t size() const { return m_count; }
+
+private:
+    size_t m_count;
+    void* m_slots[CAPACITY];
+
+    /**
+     *  Takes `REFILL_SIZE` slots from `t_pool`.
+     *  @return the number of slots that were cached.
+     */
+    size_t refill(GlobalLinkedPool& t_pool);
+
+    /**
+     *  Returns the `t_n` least recently cached slots to `t_pool`.
+     */
+    void flush(GlobalLinkedPool& t_pool, size_t t_n);
+};
+}
+
+#endif // __SLOT_CACHE_H__
@@ -0,0 +1,58 @@
+/**
+ *  @file AllocTrace.hpp
+ *  The binary format of the allocation traces that are replayed by
+ *  `bench_replay`.
+ *  @par
+ *  A trace is a `TraceHeader` followed by `TraceRecord`s in native byte
+ *  order. The records of a thread are in the order it made them, while the
+ *  records of different threads may be interleaved in any order, so a
+ *  reader orders them by their timestamps.
+ */
+
+#ifndef __ALLOC_TRACE_H__
+#define __ALLOC_TRACE_H__
+
+#include <cstdint>
+
+namespace rpools {
+
+/** The first 4 bytes of a trace, "RPTR" in a little-endian file. */
+const uint32_t TRACE_MAGIC = 0x52545052;
+const uint32_t TRACE_VERSION = 1;
+
+struct TraceHeader {
+    uint32_t magic = TRACE_MAGIC;
+    uint32_t version = TRACE_VERSION;
+};
+
+enum TraceOp : uint8_t {
+    TRACE_ALLOCATE = 0,
+    TRACE_DEALLOCATE = 1
+};
+
+/**
+ *  A single allocation or deallocation.
+ */
+struct TraceRecord {
+    /** The nanoseconds since the trace was started. */
+    uint64_t timestamp;
+    /**
+     *  The object, which is its address, so the id of a deallocated object
+     *  may be reused by a later allocation.
+     */
+    uint64_t objectId;
+    /** The size of the allocation, or 0 if a deallocation did not pass it. */
+    uint32_t size;
+    /** The thread, numbered in the order in which the threads started. */
+    uint16_t thread;
+    /** The logarithm in base 2 of the alignment. */
+    uint8_t alignmentLog2;
+    /** A `TraceOp`. */
+    uint8_t op;
+};
+
+static_assert(sizeof(TraceRecord) == 24, "TraceRecord must not be padded");
+
+}
+
+#endif // __ALLOC_TRACE_H__
@@ -0,0 +1,132 @@
+/**
+ *  @file SizeClasses.hpp
+ *  The size classes of the objects that `custom_new` allocates in pools.
+ *  @par
+ *  Sizes are mapped to a small number of classes, in the same fashion as
+ *  jemalloc:
+ *  - 8 byte steps up to 64 bytes: 8, 16, 24, ..., 64
+ *  - 16 byte steps up to 128 bytes: 80, 96, 112, 128
+ *  - 4 classes for every doubling after that, spaced at 25% at most:
+ *    160, 192, 224, 256, 320, 384, 448, 512, 640, ...
+ *  @par
+ *  Every class above 64 bytes is a multiple of 16, so its slots can be
+ *  aligned at 16 byte boundaries.
+ */
+
+#ifndef __SIZE_CLASSES_H__
+#define __SIZE_CLASSES_H__
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ *  The biggest size class, which must be a size class between 128 and 4096
+ *  bytes. Bigger allocations are served by malloc.
+ */
+#ifndef RPOOLS_MAX_SIZE_CLASS
+#define RPOOLS_MAX_SIZE_CLASS 1024
+#endif
+
+namespace rpools {
+
+/**
+ *  @return the floor of the logarithm in base 2 of `t_n`.
+ */
+constexpr size_t log2Floor(size_t t_n) {
+    return t_n < 2 ? 0 : 1 + log2Floor(t_n >> 1);
+}
+
+/**
+ *  @return the index of the smallest size class that can hold `t_size`
+ *          bytes, which must not be bigger than 4096.
+ */
+constexpr size_t computeSizeClass(size_t t_size) {
+    return t_size <= 64 ? (t_size == 0 ? 0 : (t_size + 7) / 8 - 1)
+         : t_size <= 128 ? 7 + (t_size - 64 + 15) / 16
+         : 12 + 4 * (log2Floor(t_size - 1) - 7) +
+           (t_size - 1 - (size_t(1) << log2Floor(t_size - 1))) /
+           (size_t(1) << (log2Floor(t_size - 1) - 2));
+}
+
+/**
+ *  @return the number of bytes of the size class at `t_index`.
+ */
+constexpr size_t getSizeClassSize(size_t t_index) {
+    return t_index < 8 ? 8 * (t_index + 1)
+         : t_index < 12 ? 64 + 16 * (t_index - 7)
+         : (size_t(128) << (t_index - 12) / 4) +
+           ((t_index - 12) % 4 + 1) * (size_t(32) << (t_index - 12) / 4);
+}
+
+/** The size of the biggest size class. */
+constexpr size_t MAX_SIZE_CLASS = RPOOLS_MAX_SIZE_CLASS;
+
+/** The number of size classes. */
+constexpr size_t NUM_SIZE_CLASSES = computeSizeClass(MAX_SIZE_CLASS) + 1;
+
+static_assert(MAX_SIZE_CLASS >= 128 && MAX_SIZE_CLASS <= 4096 &&
+              getSizeClassSize(NUM_SIZE_CLASSES - 1) == MAX_SIZE_CLASS,
+              "RPOOLS_MAX_SIZE_CLASS must be a size class in [128, 4096]");
+
+/**
+ *  Holds the size class of every multiple of 8 up to `MAX_SIZE_CLASS`,
+ *  which is computed at compile time.
+ */
+class SizeClassTable {
+    template<size_t... I>
+    struct Indices {};
+
+    template<typename L, typename R>
+    struct Concat;
+
+    template<size_t... L, size_t... R>
+    struct Concat<Indices<L...>, Indices<R...>> {
+        using type = Indices<L..., (sizeof...(L) + R)...>;
+    };
+
+    /** Builds `Indices<0, 1, ..., N - 1>` in logarithmic depth. */
+    template<size_t N, typename D = void>
+    struct MakeIndices {
+        using type = typename Concat<
+            typename MakeIndices<N / 2>::type,
+            typename MakeIndices<N - N / 2>::type
+        >::type;
+    };
+
+    template<typename D>
+    struct MakeIndices<0, D> { using type = Indices<>; };
+
+    template<typename D>
+    struct MakeIndices<1, D> { using type = Indices<0>; };
+
+    template<typename I>
+    struct Table;
+
+    /** Entry `i` is the class of the sizes in `(8 * (i - 1), 8 * i]`. */
+    template<size_t... I>
+    struct Table<Indices<I...>> {
+        static constexpr uint8_t classes[sizeof...(I)] = {
+            static_cast<uint8_t>(computeSizeClass(I * 8))...
+        };
+    };
+
+    using Classes = Table<MakeIndices<MAX_SIZE_CLASS / 8 + 1>::type>;
+
+    friend size_t getSizeClass(size_t t_size);
+};
+
+template<size_t... I>
+constexpr uint8_t
+SizeClassTable::Table<SizeClassTable::Indices<I...>>::classes[];
+
+/**
+ *  @return the index of the smallest size class that can hold `t_size`
+ *          bytes, which must not be bigger than `MAX_SIZE_CLASS`.
+ */
+inline size_t getSizeClass(size_t t_size) {
+    return SizeClassTable::Classes::classes[(t_size + 7) >> 3];
+}
+
+}
+
+#endif // __SIZE_CLASSES_H__
@@ -9,12 +9,14 @@
 #include <new>
 #include <cstddef>
 
+#include "rpools/tools/LMLock.hpp"
+
 /**
  *  Allocates `t_size` bytes and aligns it according to `t_alignment`.
  *  @note This function will return a nullptr when allocation fails.
  *  @param t_size the size of the allocation
- *  @param t_alignment the alignment of the allocation which cannot
- *                     be greater than 16
+ *  @param t_alignment the alignment of the allocation, a power of 2;
+ *                     alignments greater than 16 are served by malloc
  *  @return a pointer aligned to `t_alignment` of size `t_size`.
  */
 void* custom_new_no_throw(size_t t_size,
@@ -24,8 +26,8 @@ void* custom_new_no_throw(size_t t_size,
  *  Allocates `t_size` bytes and aligns it according to `t_alignment`.
  *  @note This function throws bad_alloc when allocation fails.
  *  @param t_size the size of the allocation
- *  @param t_alignment the alignment of the allocation which cannot
- *                     be greater than 16
+ *  @param t_alignment the alignment of the allocation, a power of 2;
+ *                     alignments greater than 16 are served by malloc
  *  @return a pointer aligned to `t_alignment` of size `t_size`.
  */
 void* custom_new(size_t t_size,
@@ -37,4 +39,57 @@ void* custom_new(size_t t_size,
  */
 void custom_delete(void* t_ptr) noexcept;
 
+/**
+ *  Frees up the memory that starts at `t_ptr` without looking up its pool,
+ *  because the pool follows from the size of the allocation.
+ *  @note Sizes whose class is not a multiple of 16 may have been placed in
+ *        the next class for their alignment, so their slot is read from
+ *        the pool header, and any alignment up to 16 can be given for them.
+ *  @param t_ptr the pointer that is freed
+ *  @param t_size the size `t_ptr` was allocated with
+ *  @param t_alignment the alignment `t_ptr` was allocated with
+ */
+void custom_delete(void* t_ptr, size_t t_size,
+                   size_t t_alignment=alignof(max_align_t)) noexcept;
+
+/**
+ *  Changes the size of the allocation at `t_ptr` to `t_size` bytes, in the
+ *  same way as `realloc`.
+ *  @par
+ *  The object is only moved if `t_size` belongs to another size class than
+ *  the slot of `t_ptr` (see `custom_usable_size`), which includes crossing
+ *  the size above which objects are malloc-ed.
+ *  @param t_ptr a pointer returned by `custom_new` or nullptr
+ *  @param t_size the new size of the allocation
+ *  @return a pointer to the resized allocation or nullptr if it failed, in
+ *          which case `t_ptr` is left untouched.
+ */
+void* custom_realloc(void* t_ptr, size_t t_size) noexcept;
+
+/**
+ *  @param t_ptr a pointer returned by `custom_new` or nullptr
+ *  @return the number of bytes that can be used at `t_ptr`, which is the
+ *          size of its pool slot for small objects.
+ */
+size_t custom_usable_size(void* t_ptr) noexcept;
+
+/**
+ *  Small objects that are freed by a thread are cached by that thread
+ *  so that they can be reused without taking a lock. This returns all the
+ *  objects cached by the calling thread to the shared pools.
+ *  @note The cache of a thread is flushed automatically when it exits.
+ *  @note With `RPOOLS_PERCPU_CACHES`, the objects are cached per CPU and
+ *        the caches of all the CPUs that the thread may run on are flushed.
+ */
+void custom_flush_thread_cache() noexcept;
+
+/**
+ *  @param t_size the size of an object
+ *  @return the counters of the lock of the pool in which objects of
+ *          `t_size` bytes are allocated, which are all 0 unless the project
+ *          is built with `RPOOLS_LOCK_STATS` or if such objects are
+ *          malloc-ed.
+ */
+rpools::LockStats custom_lock_stats(size_t t_size) noexcept;
+
 #endif // __CUSTOM_NEW_DELETE_H__
@@ -0,0 +1,36 @@
+#ifndef __CACHE_ALIGNED_H__
+#define __CACHE_ALIGNED_H__
+
+#include <cstddef>
+#include <utility>
+
+namespace rpools {
+
+/** The size of a cache line, the unit in which cores share memory. */
+const size_t CACHE_LINE_SIZE = 64;
+
+/**
+ *  Holds a `T` which starts on a cache line and is padded to a whole
+ *  number of cache lines, so that an array of them does not suffer from
+ *  false sharing: threads that use neighbouring elements do not bounce
+ *  the same cache line between their cores.
+ *  @note Arrays of `CacheAligned` must come from an allocator which honours
+ *        over-aligned types (e.g. `mallocator` or `new` since C++17).
+ */
+template <typename T>
+struct alignas(CACHE_LINE_SIZE) CacheAligned {
+    T value;
+
+    /**
+     *  Constructs `value` from `t_args`.
+     */
+    template <typename... Args>
+    explicit CacheAligned(Args&&... t_args)
+        : value(std::forward<Args>(t_args)...) {
+    }
+
+    CacheAligned(CacheAligned&& other) = default;
+};
+}
+
+#endif // __CACHE_ALIGNED_H__
@@ -1,35 +1,76 @@
 #ifndef __L_M_LOCK_H__
 #define __L_M_LOCK_H__
 
-#ifdef __x86_64
-#include "rpools/tools/light_lock.h"
-#else
-#include <mutex>
-#include <thread>
-#endif
+#include <atomic>
+#include <cstdint>
 
 namespace rpools {
 
 /**
- *  Represents a locking mechanism which uses light_lock_t on x86 systems
- *  and std::mutex on other systems.
+ *  The counters of an `LMLock`, which are only collected when the project
+ *  is built with `RPOOLS_LOCK_STATS` (they are all 0 otherwise).
+ */
+struct LockStats {
+    /** The number of times the lock was acquired. */
+    uint64_t acquisitions = 0;
+    /** The number of acquisitions which found the lock taken. */
+    uint64_t contentions = 0;
+    /** The time the contended acquisitions spent spinning or sleeping. */
+    uint64_t waitNanos = 0;
+};
+
+/**
+ *  Represents an adaptive lock which spins with exponential backoff for
+ *  a short while and then sleeps on a futex until it is released, so that
+ *  waiters do not burn CPU when the holder is preempted.
+ *  @par
+ *  The state of the lock is 0 when it is free, 1 when it is held and 2
+ *  when it is held and there may be sleeping waiters (Drepper, "Futexes
+ *  Are Tricky"), so an uncontended `lock`/`unlock` is one CAS and one
+ *  exchange. Systems without futexes yield instead of sleeping.
  */
 class LMLock {
 public:
+    /** The number of times a waiter checks the lock before it sleeps. */
+    static const uint32_t SPIN_ROUNDS = 16;
+    /** The maximum number of pauses between two checks. */
+    static const uint32_t MAX_BACKOFF = 64;
+
     LMLock();
     LMLock(const LMLock& other) = delete;
     LMLock& operator =(const LMLock& other) = delete;
     LMLock(LMLock&& other);
     LMLock& operator =(LMLock&& other);
     void lock();
+    /**
+     *  Acquires the lock only if it is not held by another thread.
+     *  @note The attempt is sequentially consistent even when it fails, so
+     *        a thread that publishes work and then calls `try_lock` either
+     *        takes the lock or is seen by a holder that releases the lock
+     *        and then checks for the work after a seq_cst fence (see
+     *        `GlobalLinkedPool::pushRemoteFrees`).
+     *  @return true if the lock was acquired.
+     */
+    bool try_lock();
     void unlock();
+    /**
+     *  @return the counters of the lock (see `LockStats`).
+     */
+    LockStats getStats() const;
     virtual ~LMLock() = default;
 private:
-#ifdef __x86_64
-    light_lock_t m_lock;
-#else
-    std::mutex m_lock;
+    std::atomic<uint32_t> m_state;
+#ifdef RPOOLS_LOCK_STATS
+    /** Only written while the lock is held, read at any time. */
+    std::atomic<uint64_t> m_acquisitions;
+    std::atomic<uint64_t> m_contentions;
+    std::atomic<uint64_t> m_waitNanos;
 #endif
+
+    /**
+     *  Waits for the lock after the fast path found it taken.
+     */
+    void lockSlow();
 };
 }
 
@@ -0,0 +1,63 @@
+#ifndef __NUMA_H__
+#define __NUMA_H__
+
+#include <atomic>
+#include <cstddef>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace rpools {
+
+/**
+ *  The number of NUMA nodes whose pools are indexed separately by a
+ *  `GlobalLinkedPool`, nodes with bigger numbers share the indexes of the
+ *  lower ones (see `getNumaSlot`).
+ */
+const size_t MAX_NUMA_SLOTS = 8;
+
+/** The number of CPUs whose NUMA node is remembered by `getNumaNode`. */
+const size_t MAX_NUMA_CPUS = 1024;
+
+/**
+ *  The CPU is queried with `sched_getcpu`, which glibc answers from the
+ *  vDSO, and the node of a CPU is asked from the kernel the first time the
+ *  CPU is seen. The glibc wrapper of `getcpu`, which returns both, needs
+ *  glibc 2.29. Pools are bound to their node with the `mbind` system call
+ *  (see PageProvider.cpp), so libnuma is not needed.
+ *  @return the NUMA node of the CPU that the calling thread runs on, or 0
+ *          if it is unknown.
+ */
+inline unsigned int getNumaNode() {
+    // the node of every CPU plus 1, or 0 if it is not known yet
+    static std::atomic<unsigned int> nodes[MAX_NUMA_CPUS];
+    int cpu = sched_getcpu();
+    if (cpu >= 0 && (size_t)cpu < MAX_NUMA_CPUS) {
+        unsigned int node = nodes[cpu].load(std::memory_order_relaxed);
+        if (node != 0) {
+            return node - 1;
+        }
+    }
+    unsigned int current;
+    unsigned int node;
+    if (syscall(SYS_getcpu, &current, &node, nullptr) != 0) {
+        return 0;
+    }
+    // the thread may have moved, so the node is stored for the CPU that
+    // the kernel returned it for
+    if (current < MAX_NUMA_CPUS) {
+        nodes[current].store(node + 1, std::memory_order_relaxed);
+    }
+    return node;
+}
+
+/**
+ *  @return the slot of the indexes of NUMA node `t_node`.
+ */
+inline size_t getNumaSlot(unsigned int t_node) {
+    return t_node % MAX_NUMA_SLOTS;
+}
+
+}
+
+#endif // __NUMA_H__
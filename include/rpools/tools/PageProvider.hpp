@@ -0,0 +1,57 @@
+#ifndef __PAGE_PROVIDER_H__
+#define __PAGE_PROVIDER_H__
+
+#include <cstddef>
+
+namespace rpools {
+
+/**
+ *  Gets the memory of a new pool from the system.
+ *  @par
+ *  By default, pools are allocated with `aligned_alloc`. When
+ *  `RPOOLS_MMAP_ARENAS` is defined, large virtual regions (arenas) are
+ *  reserved with `mmap` and pools are carved out of them instead. If
+ *  `RPOOLS_HUGEPAGES` is also defined, the arenas are aligned at 2 MiB and
+ *  backed by transparent huge pages.
+ *  @par
+ *  When `RPOOLS_NUMA` is defined, every NUMA node gets arenas of its own,
+ *  whose memory is bound to the node with `mbind`, and pools are allocated
+ *  on the node of the calling thread.
+ *  @par
+ *  Every pool is inserted in the `PoolMap`, so `PoolMap::contains` tells
+ *  whether a pointer belongs to a pool.
+ *  @return a pointer to `getPoolSpan()` bytes which are aligned at
+ *          `getPoolSpan()` or nullptr if there is no memory left.
+ */
+void* allocatePool();
+
+/**
+ *  Allocates a pool whose memory comes from NUMA node `t_node` if possible.
+ *  Without `RPOOLS_NUMA`, this is the same as `allocatePool()`.
+ *  @param t_node a NUMA node (see `getNumaNode`)
+ */
+void* allocatePool(unsigned int t_node);
+
+/**
+ *  Gives the memory of a pool back to the system and removes it from
+ *  the `PoolMap`.
+ *  @param t_pool a pool which was allocated with `allocatePool`
+ */
+void deallocatePool(void* t_pool);
+
+/**
+ *  Takes the locks of the arenas before the process forks (see
+ *  `GlobalPools`). Without `RPOOLS_MMAP_ARENAS` this does nothing, as
+ *  malloc takes care of its own locks.
+ */
+void lockArenasForFork();
+
+/**
+ *  Releases the locks taken by `lockArenasForFork`, in the parent and in
+ *  the child.
+ */
+void unlockArenasAfterFork();
+
+}
+
+#endif // __PAGE_PROVIDER_H__
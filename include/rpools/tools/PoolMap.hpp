@@ -0,0 +1,101 @@
+#ifndef __POOL_MAP_H__
+#define __POOL_MAP_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "rpools/tools/pool_utils.hpp"
+
+namespace rpools {
+
+/**
+ *  Records which pool spans of the address space hold a pool, so that the
+ *  owner of a pointer can be found with a couple of loads.
+ *  @par
+ *  The map is a two level radix tree over the pool numbers (an address
+ *  divided by `getPoolSpan()`) of a 48 bit address space. The root is a
+ *  static array and the leaves are bitmaps which are mapped the first time
+ *  a pool falls in their range and are never freed.
+ *  @par
+ *  The map covers 2^48 bytes with pools of 4 KiB and more with larger
+ *  spans (e.g. 2^52 with 64 KiB). Addresses above it, which mmap only hands
+ *  out with 5-level paging (LA57) when it is given such a hint, are
+ *  outside of the map: `contains` returns false for them, so malloc-ed
+ *  pointers there are still freed by malloc, and `insert` refuses the
+ *  pools there, which are then not used (see `allocatePool`).
+ *  @par
+ *  `insert` and `erase` are thread safe. `contains` never takes a lock, it
+ *  only has to see the `insert` of a pool that was handed out to its caller.
+ */
+class PoolMap {
+public:
+    /** The number of bits of an address that are mapped. */
+    static const size_t ADDRESS_BITS = 48;
+    /** The number of pool numbers covered by a leaf. */
+    static const size_t LEAF_BITS = 18;
+    /** The number of leaves of the root, enough for pools of 4 KiB. */
+    static const size_t ROOT_SIZE =
+        size_t(1) << (ADDRESS_BITS - 12 - LEAF_BITS);
+
+    /**
+     *  Marks the pool at `t_pool` as allocated.
+     *  @param t_pool a pointer that is aligned at `getPoolSpan()`
+     *  @return false if the leaf of the pool could not be allocated or the
+     *          pool is above the mapped `ADDRESS_BITS`.
+     */
+    static bool insert(const void* t_pool);
+
+    /**
+     *  Marks the pool at `t_pool` as freed.
+     *  @param t_pool a pool which was inserted
+     */
+    static void erase(const void* t_pool);
+
+    /**
+     *  @return true if `t_ptr` points inside a pool that is in the map.
+     */
+    static bool contains(const void* t_ptr) {
+        size_t number = reinterpret_cast<size_t>(t_ptr) >> getShift();
+        size_t root = number >> LEAF_BITS;
+        // the address is wider than the map (see LA57 above)
+        if (root >= ROOT_SIZE) {
+            return false;
+        }
+        Leaf* leaf = s_root[root].load(std::memory_order_acquire);
+        if (!leaf) {
+            return false;
+        }
+        size_t bit = number & LEAF_MASK;
+        uint64_t word = leaf->words[bit >> 6].load(std::memory_order_relaxed);
+        return (word >> (bit & 63)) & 1;
+    }
+
+private:
+    static const size_t LEAF_MASK = (size_t(1) << LEAF_BITS) - 1;
+
+    struct Leaf {
+        std::atomic<uint64_t> words[(size_t(1) << LEAF_BITS) / 64];
+    };
+
+    static std::atomic<Leaf*> s_root[ROOT_SIZE];
+
+    /**
+     *  @return log2(getPoolSpan()), the shift from an address to the number
+     *          of its pool.
+     */
+    static size_t getShift() {
+        static size_t shift = __builtin_ctzl(getPoolSpan());
+        return shift;
+    }
+
+    /**
+     *  @return the leaf of the pool `t_number`, which is created if needed,
+     *          or nullptr if it could not be created.
+     */
+    static Leaf* getLeaf(size_t t_number);
+};
+
+}
+
+#endif // __POOL_MAP_H__
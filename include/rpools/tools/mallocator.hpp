@@ -1,10 +1,13 @@
 #ifndef __CUSTOM_ALLOC_H__
 #define __CUSTOM_ALLOC_H__
 
+#include <cstddef>
 #include <memory>
 #include <limits>
 #include <cstdlib>
 
+#include "rpools/tools/system_alloc.hpp"
+
 // from
 // https://stackoverflow.com/questions/21081796/why-not-to-inherit-from-stdallocator
 template <typename T>
@@ -17,7 +20,11 @@ struct mallocator {
 
     T* allocate(std::size_t n) {
         if (n <= std::numeric_limits<std::size_t>::max() / sizeof(T)) {
-            if (auto ptr = std::malloc(n * sizeof(T))) {
+            // over-aligned types (see CacheAligned.hpp) need memalign
+            auto ptr = alignof(T) > alignof(max_align_t) ?
+                rpools::systemMemalign(alignof(T), n * sizeof(T)) :
+                rpools::systemMalloc(n * sizeof(T));
+            if (ptr) {
                 return static_cast<T*>(ptr);
             }
         }
@@ -25,7 +32,7 @@ struct mallocator {
     }
 
     void deallocate(T* ptr, std::size_t n) {
-        std::free(ptr);
+        rpools::systemFree(ptr);
     }
 
     template <typename U>
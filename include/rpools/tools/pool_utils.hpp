@@ -1,10 +1,23 @@
 #ifndef __POOL_UTILS_H__
 #define __POOL_UTILS_H__
 
+#include <algorithm>
 #include <cstddef>
 #include <unistd.h>
 #include <cmath>
 
+/**
+ *  The number of bytes of a pool, which must be a power of two.
+ *  Pools are only bigger than a page when this is bigger than the page size.
+ */
+#ifndef RPOOLS_POOL_SPAN
+#define RPOOLS_POOL_SPAN 0
+#endif
+
+// the pool of a slot is found by masking its address (see `getPoolMask`)
+static_assert((RPOOLS_POOL_SPAN & (RPOOLS_POOL_SPAN - 1)) == 0,
+              "RPOOLS_POOL_SPAN must be 0 or a power of two");
+
 namespace rpools {
 
 /** 
@@ -15,17 +28,63 @@ inline long int getPageSize() {
     return pageSize;
 }
 
+/**
+ *  Pools span multiple pages (a superblock) when `RPOOLS_POOL_SPAN` is
+ *  bigger than the page size, which amortises the cost of the pool header
+ *  and of the system allocator calls.
+ *  @return the number of bytes of a pool.
+ */
+inline long int getPoolSpan() {
+    static long int poolSpan = RPOOLS_POOL_SPAN > getPageSize() ?
+        RPOOLS_POOL_SPAN : getPageSize();
+    return poolSpan;
+}
+
 /** 
  *  Mask which is used to get the `PoolHeader` in constant time.
- *  Because `PoolHeader`s are page aligned, masking a pointer that is
- *  allocated in a pool will give the address of the pool's `PoolHeader`.
+ *  Because `PoolHeader`s are aligned at `getPoolSpan()` bytes, masking a
+ *  pointer that is allocated in a pool will give the address of the pool's
+ *  `PoolHeader`.
  */
 inline size_t getPoolMask() {
-    static size_t poolMask = ~0 >> (size_t) std::log2(getPageSize())
-				<< (size_t) std::log2(getPageSize());
+    static size_t poolMask = ~static_cast<size_t>(getPoolSpan() - 1);
     return poolMask;
 }
 
+/**
+ *  Groups the slots of a batch by the pool that they belong to and calls
+ *  `t_release(slots, n)` once for every pool with all of its slots, so that
+ *  the header of a pool is updated once per batch even when the slots of
+ *  several pools are interleaved.
+ *  @param t_ptrs the slots, which are reordered so that the slots of a pool
+ *                are next to each other
+ *  @param t_n the number of slots in `t_ptrs`
+ *  @param t_release called with the slots of every pool
+ */
+template <typename F>
+void releaseByPool(void** t_ptrs, size_t t_n, F t_release) {
+    size_t mask = getPoolMask();
+    auto byPool = [mask](void* t_a, void* t_b) {
+        return (reinterpret_cast<size_t>(t_a) & mask) <
+            (reinterpret_cast<size_t>(t_b) & mask);
+    };
+    // the slots of a cache usually come from a few pools in a row
+    if (!std::is_sorted(t_ptrs, t_ptrs + t_n, byPool)) {
+        std::sort(t_ptrs, t_ptrs + t_n, byPool);
+    }
+    size_t start = 0;
+    while (start < t_n) {
+        size_t pool = reinterpret_cast<size_t>(t_ptrs[start]) & mask;
+        size_t end = start + 1;
+        while (end < t_n &&
+               (reinterpret_cast<size_t>(t_ptrs[end]) & mask) == pool) {
+            ++end;
+        }
+        t_release(t_ptrs + start, end - start);
+        start = end;
+    }
+}
+
 /**
  *  @param t_l the lhs of the `%` operator
  *  @param t_powOfTwo a power of 2 which is also the rhs of the `%` operator
@@ -0,0 +1,96 @@
+#ifndef __SYSTEM_ALLOC_H__
+#define __SYSTEM_ALLOC_H__
+
+#include <cstddef>
+#include <cstdlib>
+#include <malloc.h>
+
+/**
+ *  @file system_alloc.hpp
+ *  The allocator of the system, which is used for the memory that is not
+ *  allocated in pools.
+ *  @par
+ *  When `RPOOLS_MALLOC_INTERPOSITION` is defined, `malloc` and friends are
+ *  replaced by the pools (see custom_malloc.cpp), so these functions call
+ *  the glibc implementations directly instead of going through the
+ *  replaced symbols.
+ */
+
+#ifdef RPOOLS_MALLOC_INTERPOSITION
+#include <dlfcn.h>
+
+extern "C" {
+void* __libc_malloc(size_t t_size);
+void* __libc_calloc(size_t t_num, size_t t_size);
+void* __libc_realloc(void* t_ptr, size_t t_size);
+void* __libc_memalign(size_t t_alignment, size_t t_size);
+void __libc_free(void* t_ptr);
+}
+#endif
+
+namespace rpools {
+
+inline void* systemMalloc(size_t t_size) {
+#ifdef RPOOLS_MALLOC_INTERPOSITION
+    return __libc_malloc(t_size);
+#else
+    return std::malloc(t_size);
+#endif
+}
+
+inline void* systemCalloc(size_t t_num, size_t t_size) {
+#ifdef RPOOLS_MALLOC_INTERPOSITION
+    return __libc_calloc(t_num, t_size);
+#else
+    return std::calloc(t_num, t_size);
+#endif
+}
+
+inline void* systemRealloc(void* t_ptr, size_t t_size) {
+#ifdef RPOOLS_MALLOC_INTERPOSITION
+    return __libc_realloc(t_ptr, t_size);
+#else
+    return std::realloc(t_ptr, t_size);
+#endif
+}
+
+/**
+ *  @param t_alignment a power of 2 which is a multiple of `sizeof(void*)`
+ *  @return `t_size` bytes aligned at `t_alignment` or nullptr.
+ */
+inline void* systemMemalign(size_t t_alignment, size_t t_size) {
+#ifdef RPOOLS_MALLOC_INTERPOSITION
+    return __libc_memalign(t_alignment, t_size);
+#else
+    void* ptr = nullptr;
+    return posix_memalign(&ptr, t_alignment, t_size) == 0 ? ptr : nullptr;
+#endif
+}
+
+inline void systemFree(void* t_ptr) {
+#ifdef RPOOLS_MALLOC_INTERPOSITION
+    __libc_free(t_ptr);
+#else
+    std::free(t_ptr);
+#endif
+}
+
+/**
+ *  @param t_ptr a pointer which was allocated by the system allocator
+ *  @return the number of bytes that can be used at `t_ptr`.
+ */
+inline size_t systemUsableSize(void* t_ptr) {
+#ifdef RPOOLS_MALLOC_INTERPOSITION
+    // glibc does not export its malloc_usable_size under another name
+    using UsableSize = size_t (*)(void*);
+    static UsableSize usableSize = reinterpret_cast<UsableSize>(
+        dlsym(RTLD_NEXT, "malloc_usable_size"));
+    return usableSize(t_ptr);
+#else
+    return malloc_usable_size(t_ptr);
+#endif
+}
+
+}
+
+#endif // __SYSTEM_ALLOC_H__
@@ -61,6 +61,14 @@ def plot(executable, json_file, limit):
     plot_time(alloc_range, dealloc_time_plot, 212,
               'Deallocation time of the %d implementations' %
               (num_of_implementations), labels)
+    # the latencies of the largest run
+    if any("allocation_latency" in allocator
+           for allocator in bench_results["allocators"].values()):
+        plt.figure()
+        plot_latency(bench_results, "allocation_latency", 211,
+                     'Allocation latency of %d objects' % (limit))
+        plot_latency(bench_results, "deallocation_latency", 212,
+                     'Deallocation latency of %d objects' % (limit))
 
 
 def plot_time(x, y, subplot, title, labels):
@@ -87,6 +95,35 @@ def plot_time(x, y, subplot, title, labels):
     plt.legend()
 
 
+def plot_latency(bench_results, key, subplot, title):
+    """
+    Plot the latency percentiles of every allocator which recorded them.
+    :param bench_results: the JSON of a benchmark
+    :type bench_results: dict
+    :param key: allocation_latency or deallocation_latency
+    :type key: str
+    :param subplot: the subplot to use
+    :type subplot: int
+    :param title: the title of the plot
+    :type title: str
+    """
+    plt.subplot(subplot)
+    plt.title(title)
+    ticks = []
+    for name, allocator in bench_results["allocators"].items():
+        if key not in allocator:
+            continue
+        percentiles = allocator[key]["percentiles"]
+        ticks = ['max' if p == 100 else 'p%g' % p for p, _ in percentiles]
+        plt.plot(range(len(percentiles)), [v for _, v in percentiles],
+                 marker='o', label=name)
+    plt.xticks(range(len(ticks)), ticks)
+    plt.yscale('log')
+    plt.xlabel('Percentile')
+    plt.ylabel('ns')
+    plt.legend()
+
+
 if __name__ == "__main__":
     import os
     import argparse
@@ -0,0 +1,69 @@
+#!/usr/bin/python3
+
+import json
+import subprocess
+import matplotlib.pyplot as plt
+
+
+def get_json(json_file):
+    """
+    Return the JSON found in the given file.
+    :param json_file: the file which contains the JSON
+    :type json_file: str
+    :returns: dict
+    """
+    with open(json_file) as f:
+        content = json.load(f)
+    return content
+
+
+def plot(executable, json_file, num_of_objects, num_of_threads):
+    """
+    Run <executable> once and plot the operations per second of every
+    scenario against the number of threads.
+    :param executable: the path to the executable
+    :type executable: str
+    :param json_file: the file which contains the JSON
+    :type json_file: str
+    :param num_of_objects: the number of objects per thread
+    :type num_of_objects: int
+    :param num_of_threads: the maximum number of threads
+    :type num_of_threads: int
+    """
+    subprocess.run([executable, str(num_of_objects), str(num_of_threads)])
+    bench_results = get_json(json_file)
+    scenarios = bench_results["scenarios"]
+    for i, (name, scenario) in enumerate(scenarios.items()):
+        plt.subplot(len(scenarios), 1, i + 1)
+        plt.title('Scalability of the %s scenario' % name)
+        for allocator, results in scenario["allocators"].items():
+            plt.plot(scenario["threads"], results["ops_per_sec"],
+                     marker='o', label=allocator)
+        plt.xlabel('Number of threads')
+        plt.ylabel('ops/sec')
+        plt.legend()
+
+
+if __name__ == "__main__":
+    import os
+    import argparse
+    parser = argparse.ArgumentParser(description='Plot the scalability'
+                                     ' benchmark')
+    parser.add_argument('--benchmark', '-b', help='The benchmark to run '
+                        '(default: bench_threads)',
+                        default="./build/benchmarks/elapsed_time/"
+                        "bench_threads")
+    parser.add_argument('--objects', '-n',
+                        help='The number of objects per thread '
+                        '(default: 100000)',
+                        type=int, default=100000)
+    parser.add_argument('--threads', '-t',
+                        help='The maximum number of threads '
+                        '(default: the number of CPUs)',
+                        type=int, default=max(2, os.cpu_count()))
+    args = parser.parse_args()
+    json_file = args.benchmark.split(os.path.sep)[-1].split('_')[-1] + \
+        '_time_taken.json'
+    plot(args.benchmark, json_file, args.objects, args.threads)
+    plt.tight_layout()
+    plt.show()
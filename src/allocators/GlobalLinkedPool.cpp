@@ -1,19 +1,21 @@
+#include <algorithm>
 #include <cstdlib>
 #include <new>
-#include <cstring>
+#include <utility>
 
 #include "rpools/allocators/GlobalLinkedPool.hpp"
+#include "rpools/tools/PageProvider.hpp"
 
 using namespace rpools;
 
 GlobalLinkedPool::GlobalLinkedPool(size_t t_sizeOfObjects,
                                    size_t t_alignment)
-    : m_freePools(),
-      m_poolLock(),
+    : m_poolLock(),
+      m_nodes(),
       m_sizeOfObjects(t_sizeOfObjects < sizeof(Node) ?
                       sizeof(Node) : t_sizeOfObjects),
-      m_slotSize(m_sizeOfObjects) {
-    avl_init(&m_freePools, nullptr);
+      m_slotSize(m_sizeOfObjects),
+      m_remoteFrees(nullptr) {
     // make sure the first slot starts at a proper alignment
     size_t diff = mod(sizeof(PoolHeaderG), t_alignment);
     if (diff != 0) {
@@ -24,86 +26,278 @@ GlobalLinkedPool::GlobalLinkedPool(size_t t_sizeOfObjects,
     if (diff != 0) {
         m_slotSize += t_alignment - diff;
     }
-    m_poolSize = (getPageSize() - sizeof(PoolHeaderG) - m_headerPadding) /
+    m_poolSize = (getPoolSpan() - sizeof(PoolHeaderG) - m_headerPadding) /
         m_slotSize;
+    for (auto& node : m_nodes) {
+        node.freePools = PoolIndex(m_poolSize);
+    }
+}
+
+GlobalLinkedPool::GlobalLinkedPool(GlobalLinkedPool&& other)
+    : m_poolLock(std::move(other.m_poolLock)),
+      m_sizeOfObjects(other.m_sizeOfObjects),
+      m_headerPadding(other.m_headerPadding),
+      m_slotSize(other.m_slotSize),
+      m_poolSize(other.m_poolSize),
+      m_remoteFrees(other.m_remoteFrees.exchange(nullptr)) {
+    for (size_t i = 0; i < NUM_NODE_SLOTS; ++i) {
+        m_nodes[i] = other.m_nodes[i];
+        other.m_nodes[i].freePools = PoolIndex(m_poolSize);
+        other.m_nodes[i].emptyPools = EmptyPoolCache(0);
+    }
+}
+
+GlobalLinkedPool::~GlobalLinkedPool() {
+    for (auto& node : m_nodes) {
+        node.emptyPools.trim();
+    }
 }
 
 void* GlobalLinkedPool::allocate() {
     m_poolLock.lock();
-    if (m_freePool) {
-        return nextFree(m_freePool);
+    drainRemoteFrees();
+    Pool pool = getFreePool();
+    void* toReturn = pool ? nextFree(pool) : nullptr;
+    unlock();
+    return toReturn;
+}
+
+void GlobalLinkedPool::deallocate(void* t_ptr) {
+    if (m_poolLock.try_lock()) {
+        release(t_ptr);
+        unlock();
     } else {
-        Pool pool = pool_first(&m_freePools);
-        if (pool) {
-            return nextFree(pool);
-        } else {
-            // create a new pool because there are no free pool slots left
-            size_t pageSize = getPageSize();
-            Pool pool = aligned_alloc(pageSize, pageSize);
-            std::memset(pool, 0, pageSize);
-            constructPoolHeader(reinterpret_cast<char*>(pool));
-            pool_insert(&m_freePools, pool);
-            m_freePool = pool;
-            return nextFree(pool);
+        auto node = new (t_ptr) Node();
+        pushRemoteFrees(node, node);
+    }
+}
+
+size_t GlobalLinkedPool::allocateBulk(void** t_out, size_t t_n) {
+    size_t allocated = 0;
+    m_poolLock.lock();
+    drainRemoteFrees();
+    while (allocated < t_n) {
+        Pool pool = getFreePool();
+        if (!pool) {
+            break;
         }
+        allocated += nextFree(pool, t_out + allocated, t_n - allocated);
     }
+    unlock();
+    return allocated;
 }
 
-void GlobalLinkedPool::deallocate(void* t_ptr) {
-    // get the pool of ptr
+void GlobalLinkedPool::deallocateBulk(void** t_ptrs, size_t t_n) {
+    if (t_n == 0) {
+        return;
+    }
+    if (m_poolLock.try_lock()) {
+        releaseBulk(t_ptrs, t_n);
+        unlock();
+    } else {
+        // link the slots together so that they are pushed all at once
+        auto first = new (t_ptrs[0]) Node();
+        Node* last = first;
+        for (size_t i = 1; i < t_n; ++i) {
+            last->next = new (t_ptrs[i]) Node();
+            last = last->next;
+        }
+        pushRemoteFrees(first, last);
+    }
+}
+
+void GlobalLinkedPool::trim() {
+    m_poolLock.lock();
+    drainRemoteFrees();
+    for (auto& node : m_nodes) {
+        node.emptyPools.trim();
+    }
+    unlock();
+}
+
+void GlobalLinkedPool::setEmptyPoolLimit(size_t t_limit) {
+    m_poolLock.lock();
+    for (auto& node : m_nodes) {
+        node.emptyPools.setLimit(t_limit);
+    }
+    unlock();
+}
+
+size_t GlobalLinkedPool::getNumberOfEmptyPools() const {
+    size_t count = 0;
+    for (auto& node : m_nodes) {
+        count += node.emptyPools.size();
+    }
+    return count;
+}
+
+size_t GlobalLinkedPool::getNumberOfPools() const {
+    size_t count = 0;
+    for (auto& node : m_nodes) {
+        count += node.freePools.count();
+    }
+    return count;
+}
+
+Pool GlobalLinkedPool::getFreePool() {
+    NodePools& node = getNodePools();
+    // prefer the fullest pool so that sparse pools can be freed
+    Pool pool = node.freePools.first();
+    if (!pool) {
+        // reuse an empty pool or create a new one because there are no
+        // free pool slots left
+        pool = node.emptyPools.pop();
+        if (!pool) {
+#ifdef RPOOLS_NUMA
+            pool = allocatePool(getNumaNode());
+#else
+            pool = allocatePool();
+#endif
+        }
+        if (!pool) {
+            return nullptr;
+        }
+        constructPoolHeader(reinterpret_cast<char*>(pool));
+#ifdef RPOOLS_NUMA
+        reinterpret_cast<PoolHeaderG*>(pool)->numaSlot = &node - m_nodes;
+#endif
+        node.freePools.insert(pool, 0);
+    }
+    return pool;
+}
+
+GlobalLinkedPool::NodePools& GlobalLinkedPool::getNodePools() {
+#ifdef RPOOLS_NUMA
+    return m_nodes[getNumaSlot(getNumaNode())];
+#else
+    return m_nodes[0];
+#endif
+}
+
+GlobalLinkedPool::NodePools& GlobalLinkedPool::getNodePools(Pool t_pool) {
+#ifdef RPOOLS_NUMA
+    return m_nodes[reinterpret_cast<PoolHeaderG*>(t_pool)->numaSlot];
+#else
+    (void)t_pool;
+    return m_nodes[0];
+#endif
+}
+
+void GlobalLinkedPool::release(void* t_ptr) {
+    release(&t_ptr, 1);
+}
+
+void GlobalLinkedPool::release(void** t_ptrs, size_t t_n) {
+    // get the pool of the slots
     auto pool = reinterpret_cast<PoolHeaderG*>(
-        reinterpret_cast<size_t>(t_ptr) & getPoolMask()
+        reinterpret_cast<size_t>(t_ptrs[0]) & getPoolMask()
     );
-    m_poolLock.lock();
-    if (pool->occupiedSlots == 1) {
-        pool_remove(&m_freePools, pool);
-        free(pool);
-        m_freePool = pool_first(&m_freePools);
-    } else {
-        auto newNode = new (t_ptr) Node();
-        // update nodes to point to the newly create Node
-        Node& head = pool->head;
+    NodePools& node = getNodePools(pool);
+    size_t oldOccupied = pool->occupiedSlots;
+    if (oldOccupied == t_n) {
+        // a full pool is not in the index
+        if (oldOccupied < m_poolSize) {
+            node.freePools.remove(pool, oldOccupied);
+        }
+        node.emptyPools.push(pool);
+        return;
+    }
+    // update nodes to point to the newly created Nodes
+    Node& head = pool->head;
+    for (size_t i = 0; i < t_n; ++i) {
+        auto newNode = new (t_ptrs[i]) Node();
         newNode->next = head.next;
         head.next = newNode;
-        m_freePool = pool;
-        if (--(pool->occupiedSlots) == m_poolSize - 1) {
-            pool_insert(&m_freePools, pool);
-        }
     }
-    m_poolLock.unlock();
+    size_t occupied = pool->occupiedSlots -= t_n;
+    if (oldOccupied == m_poolSize) {
+        node.freePools.insert(pool, occupied);
+    } else {
+        node.freePools.update(pool, oldOccupied, occupied);
+    }
+}
+
+void GlobalLinkedPool::releaseBulk(void** t_ptrs, size_t t_n) {
+    releaseByPool(t_ptrs, t_n, [this](void** t_slots, size_t t_count) {
+        release(t_slots, t_count);
+    });
 }
 
 void GlobalLinkedPool::constructPoolHeader(char* t_ptr) {
     // first slot after the header that is also aligned
-    auto headNext = reinterpret_cast<Node*>(sizeof(PoolHeaderG) +
-                                            t_ptr + m_headerPadding);
-    // create the header at the start of the pool
-    new (t_ptr) PoolHeaderG(m_sizeOfObjects, headNext);
-    // skip the header
-    t_ptr = reinterpret_cast<char*>(headNext);
-    // for each slot in the pool, create a node that is linked to the next slot
-    for (size_t i = 0; i < m_poolSize - 1; ++i) {
-        auto newNode = new (t_ptr) Node();
-        t_ptr += m_slotSize;
-        newNode->next = reinterpret_cast<Node*>(t_ptr);
-    }
-    // create last node of the list, which isn't linked to anything
-    new (t_ptr) Node();
-}
-
-void* GlobalLinkedPool::nextFree(Pool pool) {
-    auto header = reinterpret_cast<PoolHeaderG*>(pool);
+    char* firstSlot = t_ptr + sizeof(PoolHeaderG) + m_headerPadding;
+    // create the header at the start of the pool, the slots are only
+    // touched once they are allocated
+    new (t_ptr) PoolHeaderG(m_sizeOfObjects, firstSlot);
+}
+
+void* GlobalLinkedPool::nextFree(Pool t_pool) {
+    void* toReturn = nullptr;
+    nextFree(t_pool, &toReturn, 1);
+    return toReturn;
+}
+
+size_t GlobalLinkedPool::nextFree(Pool t_pool, void** t_out, size_t t_n) {
+    auto header = reinterpret_cast<PoolHeaderG*>(t_pool);
+    size_t oldOccupied = header->occupiedSlots;
+    size_t n = std::min(t_n, m_poolSize - oldOccupied);
     Node& head = header->head;
-    void* toReturn = head.next;
-    if (toReturn) {
-        head.next = head.next->next;
-        if (++(header->occupiedSlots) == m_poolSize) {
-            pool_remove(&m_freePools, pool);
-            m_freePool = pool_first(&m_freePools);
+    for (size_t i = 0; i < n; ++i) {
+        if (head.next) {
+            t_out[i] = head.next;
+            head.next = head.next->next;
+        } else {
+            // the pool is not full, so the free slots are in the unused tail
+            t_out[i] = header->unusedTail;
+            header->unusedTail += m_slotSize;
         }
     }
+    size_t occupied = header->occupiedSlots += n;
+    NodePools& node = getNodePools(t_pool);
+    if (occupied == m_poolSize) {
+        node.freePools.remove(t_pool, oldOccupied);
+    } else {
+        node.freePools.update(t_pool, oldOccupied, occupied);
+    }
+    return n;
+}
+
+void GlobalLinkedPool::pushRemoteFrees(Node* t_first, Node* t_last) {
+    Node* head = m_remoteFrees.load(std::memory_order_relaxed);
+    do {
+        t_last->next = head;
+    } while (!m_remoteFrees.compare_exchange_weak(head, t_first));
+    // the holder of the lock might have released it before the push
+    // was visible, in which case nobody else will drain the list
+    if (m_poolLock.try_lock()) {
+        drainRemoteFrees();
+        unlock();
+    }
+}
+
+void GlobalLinkedPool::drainRemoteFrees() {
+    if (!m_remoteFrees.load(std::memory_order_relaxed)) {
+        return;
+    }
+    Node* node = m_remoteFrees.exchange(nullptr, std::memory_order_acquire);
+    while (node) {
+        Node* next = node->next;
+        release(node);
+        node = next;
+    }
+}
+
+void GlobalLinkedPool::unlock() {
     m_poolLock.unlock();
-    return toReturn;
+    // a deallocating thread may have pushed remote frees after failing to
+    // take the lock, so check for them once the lock is released
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (m_remoteFrees.load(std::memory_order_relaxed) &&
+           m_poolLock.try_lock()) {
+        drainRemoteFrees();
+        m_poolLock.unlock();
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
 }
 
 const PoolHeaderG& GlobalLinkedPool::getPoolHeader(void* t_ptr) {
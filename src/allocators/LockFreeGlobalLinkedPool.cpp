@@ -0,0 +1,280 @@
+#include <cstdint>
+#include <new>
+#include <thread>
+
+#include "rpools/allocators/LockFreeGlobalLinkedPool.hpp"
+#include "rpools/tools/PageProvider.hpp"
+
+using namespace rpools;
+
+namespace {
+    /**
+     *  @return the top of a free list which holds the slot at `t_offset`
+     *          and the tag that follows the one of `t_top`.
+     */
+    uint64_t retag(uint64_t t_top, uint64_t t_offset) {
+        return (((t_top >> 32) + 1) << 32) | t_offset;
+    }
+}
+
+LockFreeGlobalLinkedPool::LockFreeGlobalLinkedPool(size_t t_sizeOfObjects,
+                                                   size_t t_alignment)
+    : m_freePools(),
+      m_emptyPools(),
+      m_poolLock(),
+      m_sizeOfObjects(t_sizeOfObjects < sizeof(Node) ?
+                      sizeof(Node) : t_sizeOfObjects),
+      m_slotSize(m_sizeOfObjects),
+      m_current(nullptr),
+      m_epoch(0),
+      m_allocators{{0}, {0}} {
+    // make sure the first slot starts at a proper alignment
+    size_t diff = mod(sizeof(Header), t_alignment);
+    if (diff != 0) {
+        m_headerPadding += t_alignment - diff;
+    }
+    // make sure that slots are properly aligned
+    diff = mod(m_slotSize, t_alignment);
+    if (diff != 0) {
+        m_slotSize += t_alignment - diff;
+    }
+    m_poolSize = (getPoolSpan() - sizeof(Header) - m_headerPadding) /
+        m_slotSize;
+    m_freePools = PoolIndex(m_poolSize);
+}
+
+LockFreeGlobalLinkedPool::LockFreeGlobalLinkedPool(
+    LockFreeGlobalLinkedPool&& other)
+    : m_freePools(other.m_freePools),
+      m_emptyPools(other.m_emptyPools),
+      m_poolLock(std::move(other.m_poolLock)),
+      m_sizeOfObjects(other.m_sizeOfObjects),
+      m_headerPadding(other.m_headerPadding),
+      m_slotSize(other.m_slotSize),
+      m_poolSize(other.m_poolSize),
+      m_current(other.m_current.exchange(nullptr)),
+      m_epoch(0),
+      m_allocators{{0}, {0}} {
+    other.m_freePools = PoolIndex(m_poolSize);
+    other.m_emptyPools = EmptyPoolCache(0);
+}
+
+LockFreeGlobalLinkedPool::~LockFreeGlobalLinkedPool() {
+    Header* current = m_current.load();
+    if (current && current->occupiedSlots.load() == 0) {
+        m_emptyPools.push(current);
+    }
+    m_emptyPools.trim();
+}
+
+void* LockFreeGlobalLinkedPool::allocate() {
+    // announce the allocation so that the current pool is not released
+    // while it is being popped
+    std::atomic<size_t>& allocators = m_allocators[m_epoch.load() & 1];
+    allocators.fetch_add(1);
+    Header* pool = m_current.load();
+    void* toReturn = pool ? pop(pool) : nullptr;
+    allocators.fetch_sub(1);
+    return toReturn ? toReturn : allocateLocked();
+}
+
+void LockFreeGlobalLinkedPool::deallocate(void* t_ptr) {
+    release(&t_ptr, 1);
+}
+
+size_t LockFreeGlobalLinkedPool::allocateBulk(void** t_out, size_t t_n) {
+    size_t allocated = 0;
+    while (allocated < t_n) {
+        t_out[allocated] = allocate();
+        if (!t_out[allocated]) {
+            break;
+        }
+        ++allocated;
+    }
+    return allocated;
+}
+
+void LockFreeGlobalLinkedPool::deallocateBulk(void** t_ptrs, size_t t_n) {
+    releaseByPool(t_ptrs, t_n, [this](void** t_slots, size_t t_count) {
+        release(t_slots, t_count);
+    });
+}
+
+void LockFreeGlobalLinkedPool::trim() {
+    m_poolLock.lock();
+    m_emptyPools.trim();
+    m_poolLock.unlock();
+}
+
+void LockFreeGlobalLinkedPool::setEmptyPoolLimit(size_t t_limit) {
+    m_poolLock.lock();
+    m_emptyPools.setLimit(t_limit);
+    m_poolLock.unlock();
+}
+
+void* LockFreeGlobalLinkedPool::allocateLocked() {
+    m_poolLock.lock();
+    void* toReturn = nullptr;
+    while (!toReturn) {
+        Header* pool = m_current.load();
+        if (pool) {
+            toReturn = pop(pool);
+            if (toReturn) {
+                break;
+            }
+            // a deallocation which did not see the pool being detached
+            // pushed its slot before this check (see `release`)
+            pool->state.store(Header::DETACHED);
+            if (pool->toNode(pool->freeList.load())) {
+                pool->state.store(Header::CURRENT);
+                continue;
+            }
+            m_current.store(nullptr);
+        }
+        pool = getFreePool();
+        if (!pool) {
+            break;
+        }
+        pool->state.store(Header::CURRENT);
+        m_current.store(pool);
+    }
+    m_poolLock.unlock();
+    return toReturn;
+}
+
+LockFreePoolHeader* LockFreeGlobalLinkedPool::getFreePool() {
+    // prefer the fullest pool so that sparse pools can be freed
+    auto pool = static_cast<Header*>(m_freePools.first());
+    if (pool) {
+        m_freePools.remove(pool, pool->indexedOccupancy);
+        return pool;
+    }
+    // reuse an empty pool or create a new one because there are no
+    // free pool slots left
+    Pool empty = m_emptyPools.pop();
+    if (!empty) {
+        empty = allocatePool();
+    }
+    if (!empty) {
+        return nullptr;
+    }
+    constructPoolHeader(static_cast<char*>(empty));
+    return static_cast<Header*>(empty);
+}
+
+void* LockFreeGlobalLinkedPool::pop(Header* t_pool) {
+    uint64_t top = t_pool->freeList.load(std::memory_order_acquire);
+    Node* node;
+    uint64_t newTop;
+    do {
+        node = t_pool->toNode(top);
+        if (!node) {
+            return nullptr;
+        }
+        // the slot may be allocated and overwritten by another thread in
+        // the meantime, but then the tag has changed and the CAS fails
+        Node* next = __atomic_load_n(&node->next, __ATOMIC_RELAXED);
+        newTop = retag(top, t_pool->toOffset(next));
+    } while (!t_pool->freeList.compare_exchange_weak(top, newTop));
+    t_pool->occupiedSlots.fetch_add(1);
+    return node;
+}
+
+void LockFreeGlobalLinkedPool::release(void** t_ptrs, size_t t_n) {
+    auto pool = reinterpret_cast<Header*>(
+        reinterpret_cast<size_t>(t_ptrs[0]) & getPoolMask()
+    );
+    // link the slots together so that they are pushed all at once
+    auto first = new (t_ptrs[0]) Node();
+    Node* last = first;
+    for (size_t i = 1; i < t_n; ++i) {
+        last->next = new (t_ptrs[i]) Node();
+        last = last->next;
+    }
+    uint64_t top = pool->freeList.load();
+    uint64_t newTop;
+    do {
+        last->next = pool->toNode(top);
+        newTop = retag(top, pool->toOffset(first));
+    } while (!pool->freeList.compare_exchange_weak(top, newTop));
+    // the slots are uncounted last, so that the pool cannot be released
+    // before the pool lock is taken below
+    if (pool->state.load() != Header::DETACHED) {
+        size_t occupied = pool->occupiedSlots.load();
+        while (occupied > t_n) {
+            if (pool->occupiedSlots.compare_exchange_weak(occupied,
+                                                          occupied - t_n)) {
+                return;
+            }
+        }
+    }
+    // the pool becomes empty or it has to be indexed again
+    m_poolLock.lock();
+    releaseLocked(pool, t_n);
+    m_poolLock.unlock();
+}
+
+void LockFreeGlobalLinkedPool::releaseLocked(Header* t_pool, size_t t_n) {
+    size_t occupied = t_pool->occupiedSlots.fetch_sub(t_n) - t_n;
+    if (t_pool->state.load() == Header::DETACHED) {
+        index(t_pool, occupied);
+    }
+    if (occupied == 0) {
+        releaseEmpty(t_pool);
+    }
+}
+
+void LockFreeGlobalLinkedPool::releaseEmpty(Header* t_pool) {
+    if (t_pool->state.load() == Header::CURRENT) {
+        m_current.store(nullptr);
+    } else {
+        m_freePools.remove(t_pool, t_pool->indexedOccupancy);
+    }
+    t_pool->state.store(Header::DETACHED);
+    synchronize();
+    size_t occupied = t_pool->occupiedSlots.load();
+    if (occupied == 0) {
+        m_emptyPools.push(t_pool);
+    } else {
+        // an allocation which still had the pool took a slot
+        index(t_pool, occupied);
+    }
+}
+
+void LockFreeGlobalLinkedPool::index(Header* t_pool, size_t t_occupied) {
+    if (t_occupied < m_poolSize) {
+        t_pool->indexedOccupancy = t_occupied;
+        t_pool->state.store(Header::INDEXED);
+        m_freePools.insert(t_pool, t_occupied);
+    }
+}
+
+void LockFreeGlobalLinkedPool::synchronize() {
+    // allocations that start after a flip announce themselves in the other
+    // epoch, so two flips wait for every allocation that started before
+    for (size_t i = 0; i < 2; ++i) {
+        size_t epoch = m_epoch.fetch_add(1) & 1;
+        while (m_allocators[epoch].load() != 0) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void LockFreeGlobalLinkedPool::constructPoolHeader(char* t_ptr) {
+    // first slot after the header that is also aligned
+    char* firstSlot = t_ptr + sizeof(Header) + m_headerPadding;
+    // link all the slots, as the free list is the only source of slots
+    char* slot = firstSlot;
+    for (size_t i = 1; i < m_poolSize; ++i) {
+        new (slot) Node(reinterpret_cast<Node*>(slot + m_slotSize));
+        slot += m_slotSize;
+    }
+    new (slot) Node();
+    new (t_ptr) Header(m_sizeOfObjects, firstSlot);
+}
+
+const LockFreePoolHeader& LockFreeGlobalLinkedPool::getPoolHeader(
+    void* t_ptr) {
+    size_t poolAddress = reinterpret_cast<size_t>(t_ptr) & getPoolMask();
+    return *reinterpret_cast<LockFreePoolHeader*>(poolAddress);
+}
@@ -1,18 +1,19 @@
+#include <algorithm>
 #include <cstdlib>
 #include <new>
-#include <cstring>
 
 #include "rpools/allocators/NSGlobalLinkedPool.hpp"
+#include "rpools/tools/PageProvider.hpp"
 
 using namespace rpools;
 
 NSGlobalLinkedPool::NSGlobalLinkedPool(size_t t_sizeOfObjects,
                                        size_t t_alignment)
     : m_freePools(),
+      m_emptyPools(),
       m_sizeOfObjects(t_sizeOfObjects < sizeof(Node) ?
                       sizeof(Node) : t_sizeOfObjects),
       m_slotSize(m_sizeOfObjects) {
-    avl_init(&m_freePools, nullptr);
     // make sure the first slot starts at a proper alignment
     size_t diff = mod(sizeof(PoolHeaderG), t_alignment);
     if (diff != 0) {
@@ -23,82 +24,132 @@ NSGlobalLinkedPool::NSGlobalLinkedPool(size_t t_sizeOfObjects,
     if (diff != 0) {
         m_slotSize += t_alignment - diff;
     }
-    m_poolSize = (getPageSize() - sizeof(PoolHeaderG) - m_headerPadding) /
+    m_poolSize = (getPoolSpan() - sizeof(PoolHeaderG) - m_headerPadding) /
         m_slotSize;
+    m_freePools = PoolIndex(m_poolSize);
+}
+
+NSGlobalLinkedPool::~NSGlobalLinkedPool() {
+    m_emptyPools.trim();
 }
 
 void* NSGlobalLinkedPool::allocate() {
-    if (m_freePool) {
-        return nextFree(m_freePool);
-    } else {
-        Pool pool = pool_first(&m_freePools);
-        if (pool) {
-            return nextFree(pool);
-        } else {
-            // create a new pool because there are no free pool slots left
-            size_t pageSize = getPageSize();
-            Pool pool = aligned_alloc(pageSize, pageSize);
-            std::memset(pool, 0, pageSize);
-            constructPoolHeader(reinterpret_cast<char*>(pool));
-            pool_insert(&m_freePools, pool);
-            m_freePool = pool;
-            return nextFree(pool);
-        }
+    void* toReturn = nullptr;
+    Pool pool = getFreePool();
+    if (pool) {
+        nextFree(pool, &toReturn, 1);
     }
+    return toReturn;
 }
 
 void NSGlobalLinkedPool::deallocate(void* t_ptr) {
-    // get the pool of ptr
-    auto pool = reinterpret_cast<PoolHeaderG*>(
-        reinterpret_cast<size_t>(t_ptr) & getPoolMask()
-    );
-    if (pool->occupiedSlots == 1) {
-        pool_remove(&m_freePools, pool);
-        free(pool);
-        m_freePool = pool_first(&m_freePools);
-    } else {
-        auto newNode = new (t_ptr) Node();
-        // update nodes to point to the newly create Node
-        Node& head = pool->head;
-        newNode->next = head.next;
-        head.next = newNode;
-        m_freePool = pool;
-        if (--(pool->occupiedSlots) == m_poolSize - 1) {
-            pool_insert(&m_freePools, pool);
+    release(&t_ptr, 1);
+}
+
+size_t NSGlobalLinkedPool::allocateBulk(void** t_out, size_t t_n) {
+    size_t allocated = 0;
+    while (allocated < t_n) {
+        Pool pool = getFreePool();
+        if (!pool) {
+            break;
+        }
+        allocated += nextFree(pool, t_out + allocated, t_n - allocated);
+    }
+    return allocated;
+}
+
+void NSGlobalLinkedPool::deallocateBulk(void** t_ptrs, size_t t_n) {
+    releaseByPool(t_ptrs, t_n, [this](void** t_slots, size_t t_count) {
+        release(t_slots, t_count);
+    });
+}
+
+void NSGlobalLinkedPool::trim() {
+    m_emptyPools.trim();
+}
+
+void NSGlobalLinkedPool::setEmptyPoolLimit(size_t t_limit) {
+    m_emptyPools.setLimit(t_limit);
+}
+
+Pool NSGlobalLinkedPool::getFreePool() {
+    // prefer the fullest pool so that sparse pools can be freed
+    Pool pool = m_freePools.first();
+    if (!pool) {
+        // reuse an empty pool or create a new one because there are no
+        // free pool slots left
+        pool = m_emptyPools.pop();
+        if (!pool) {
+            pool = allocatePool();
         }
+        if (!pool) {
+            return nullptr;
+        }
+        constructPoolHeader(reinterpret_cast<char*>(pool));
+        m_freePools.insert(pool, 0);
     }
+    return pool;
 }
 
 void NSGlobalLinkedPool::constructPoolHeader(char* t_ptr) {
     // first slot after the header that is also aligned
-    auto headNext = reinterpret_cast<Node*>(sizeof(PoolHeaderG) +
-                                             t_ptr + m_headerPadding);
-    // create the header at the start of the pool
-    new (t_ptr) PoolHeaderG(m_sizeOfObjects, headNext);
-    // skip the header
-    t_ptr = reinterpret_cast<char*>(headNext);
-    // for each slot in the pool, create a node that is linked to the next slot
-    for (size_t i = 0; i < m_poolSize - 1; ++i) {
-        auto newNode = new (t_ptr) Node();
-        t_ptr += m_slotSize;
-        newNode->next = reinterpret_cast<Node*>(t_ptr);
-    }
-    // create last node of the list, which isn't linked to anything
-    new (t_ptr) Node();
+    char* firstSlot = t_ptr + sizeof(PoolHeaderG) + m_headerPadding;
+    // create the header at the start of the pool, the slots are only
+    // touched once they are allocated
+    new (t_ptr) PoolHeaderG(m_sizeOfObjects, firstSlot);
 }
 
-void* NSGlobalLinkedPool::nextFree(Pool pool) {
-    auto header = reinterpret_cast<PoolHeaderG*>(pool);
+size_t NSGlobalLinkedPool::nextFree(Pool t_pool, void** t_out, size_t t_n) {
+    auto header = reinterpret_cast<PoolHeaderG*>(t_pool);
+    size_t oldOccupied = header->occupiedSlots;
+    size_t n = std::min(t_n, m_poolSize - oldOccupied);
     Node& head = header->head;
-    void* toReturn = head.next;
-    if (toReturn) {
-        head.next = head.next->next;
-        if (++(header->occupiedSlots) == m_poolSize) {
-            pool_remove(&m_freePools, pool);
-            m_freePool = pool_first(&m_freePools);
+    for (size_t i = 0; i < n; ++i) {
+        if (head.next) {
+            t_out[i] = head.next;
+            head.next = head.next->next;
+        } else {
+            // the pool is not full, so the free slots are in the unused tail
+            t_out[i] = header->unusedTail;
+            header->unusedTail += m_slotSize;
         }
     }
-    return toReturn;
+    size_t occupied = header->occupiedSlots += n;
+    if (occupied == m_poolSize) {
+        m_freePools.remove(t_pool, oldOccupied);
+    } else {
+        m_freePools.update(t_pool, oldOccupied, occupied);
+    }
+    return n;
+}
+
+void NSGlobalLinkedPool::release(void** t_ptrs, size_t t_n) {
+    // get the pool of the slots
+    auto pool = reinterpret_cast<PoolHeaderG*>(
+        reinterpret_cast<size_t>(t_ptrs[0]) & getPoolMask()
+    );
+    size_t oldOccupied = pool->occupiedSlots;
+    if (oldOccupied == t_n) {
+        // a full pool is not in the index
+        if (oldOccupied < m_poolSize) {
+            m_freePools.remove(pool, oldOccupied);
+        }
+        m_emptyPools.push(pool);
+        return;
+    }
+    // update nodes to point to the newly created Nodes
+    Node& head = pool->head;
+    for (size_t i = 0; i < t_n; ++i) {
+        auto newNode = new (t_ptrs[i]) Node();
+        newNode->next = head.next;
+        head.next = newNode;
+    }
+    size_t occupied = pool->occupiedSlots -= t_n;
+    if (oldOccupied == m_poolSize) {
+        m_freePools.insert(pool, occupied);
+    } else {
+        m_freePools.update(pool, oldOccupied, occupied);
+    }
 }
 
 const PoolHeaderG& NSGlobalLinkedPool::getPoolHeader(void* t_ptr) {
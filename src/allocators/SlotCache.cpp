@@ -0,0 +1,23 @@
+#include <cstring>
+
+#include "rpools/allocators/SlotCache.hpp"
+
+using namespace rpools;
+
+const size_t SlotCache::CAPACITY;
+const size_t SlotCache::REFILL_SIZE;
+
+size_t SlotCache::refill(GlobalLinkedPool& t_pool) {
+    m_count += t_pool.allocateBulk(m_slots + m_count, REFILL_SIZE);
+    return m_count;
+}
+
+void SlotCache::flush(GlobalLinkedPool& t_pool, size_t t_n) {
+    if (t_n == 0) {
+        return;
+    }
+    // the bottom of the stack holds the coldest slots
+    t_pool.deallocateBulk(m_slots, t_n);
+    m_count -= t_n;
+    std::memmove(m_slots, m_slots + t_n, m_count * sizeof(void*));
+}
@@ -1,5 +1,17 @@
 #include "rpools/avltree/avl_utils.h"
 
+#ifdef RPOOLS_MALLOC_INTERPOSITION
+/* malloc is served by the pools, which may hold a lock when they call
+ * these functions, so the nodes come from glibc directly */
+void* __libc_malloc(size_t t_size);
+void __libc_free(void* t_ptr);
+#define node_malloc __libc_malloc
+#define node_free __libc_free
+#else
+#define node_malloc malloc
+#define node_free free
+#endif
+
 int pool_cmp_func(struct avl_node *a, struct avl_node *b, void *aux) {
     struct PoolNode *aa, *bb;
     aa = _get_entry(a, struct PoolNode, avl);
@@ -25,7 +37,8 @@ size_t pool_count(const struct avl_tree* tree) {
 }
 
 void pool_insert(struct avl_tree* tree, void* t_pool) {
-    struct PoolNode* node = (struct PoolNode*) malloc(sizeof(struct PoolNode));
+    struct PoolNode* node =
+        (struct PoolNode*) node_malloc(sizeof(struct PoolNode));
     node->pool = t_pool;
     avl_insert(tree, &node->avl, pool_cmp_func);
 }
@@ -36,7 +49,7 @@ void pool_remove(struct avl_tree* tree, void* t_pool) {
     struct avl_node* res = avl_search(tree, &query.avl, pool_cmp_func);
     struct PoolNode* poolNode = _get_entry(res, struct PoolNode, avl);
     avl_remove(tree, res);
-    free(poolNode);
+    node_free(poolNode);
 }
 
 void* pool_first(struct avl_tree* tree) {
@@ -58,7 +71,8 @@ int page_cmp_func(struct avl_node *a, struct avl_node *b, void *aux) {
 }
 
 void page_insert(struct avl_tree* tree, void* t_page) {
-    struct PageNode* node = (struct PageNode*) malloc(sizeof(struct PageNode));
+    struct PageNode* node =
+        (struct PageNode*) node_malloc(sizeof(struct PageNode));
     node->pool = t_page;
     node->num = 1;
     avl_insert(tree, &node->avl, page_cmp_func);
@@ -73,5 +87,5 @@ struct avl_node* page_get(struct avl_tree* tree , void* t_page) {
 void page_remove(struct avl_tree* tree, struct avl_node* res) {
     struct PageNode* poolNode = _get_entry(res, struct PageNode, avl);
     avl_remove(tree, res);
-    free(poolNode);
+    node_free(poolNode);
 }
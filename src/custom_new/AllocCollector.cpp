@@ -1,65 +1,194 @@
 #include "AllocCollector.hpp"
+#include <new> // placement new
+#include <pthread.h> // pthread_key_create
 #include "unistd.h" // getpid
 
+namespace {
+    /** The shard of the calling thread and the collector that owns it. */
+    __thread void* __shard = nullptr;
+    __thread const void* __shardOwner = nullptr;
+    /** Whether the calling thread has handed its shard over as it exits. */
+    __thread bool __shardReleased = false;
+    pthread_key_t __shardKey;
+    pthread_once_t __shardKeyOnce = PTHREAD_ONCE_INIT;
+
+    template <typename T>
+    T* systemNew() {
+        return new (mallocator<T>().allocate(1)) T();
+    }
+}
+
 AllocCollector::AllocCollector()
     : m_objectsFile(),
+      m_shards(nullptr),
+      m_exitedShard(systemNew<Shard>()),
       m_allocObj(),
-      m_obj(),
       m_snapshots(),
-      m_mapLock(),
+      m_snapshotLock(),
       m_cv() {
+    m_exitedShard->inUse.store(true, std::memory_order_relaxed);
+    m_shards.store(m_exitedShard, std::memory_order_relaxed);
 }
 
 AllocCollector::~AllocCollector() {
-    if (m_threadStarted) {
+    if (m_snapshotThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lk(m_snapshotLock);
+            m_stopping = true;
+        }
+        m_cv.notify_one();
+        m_snapshotThread.join();
         takeSnapshot();
         m_objectsFile << m_snapshots.dump(4);
-        m_snapshotThread.detach();
     }
 }
 
-void AllocCollector::addObject(size_t t_size, size_t t_align,
-                               const char* t_name, size_t t_baseSize,
-                               const char* t_funcName, void* t_ptr) {
-    if (!m_threadStarted) {
-        m_threadStarted = true;
-        m_snapshotThread = std::thread(&AllocCollector::run, this);
-        m_objectsFile.open("object_snapshots_" + std::to_string(getpid()) +
-                           ".json");
+AllocCollector::Shard* AllocCollector::getShard() {
+    if (__shard && __shardOwner == this) {
+        return static_cast<Shard*>(__shard);
     }
-    std::unique_lock<std::mutex> lk(m_mapLock);
-    m_cv.wait(lk, [&](){ return !m_waitingToPrint; });
-    std::string name(t_name);
-    AlignedObject& alignedObj = m_allocObj[name].alignments[t_align];
-    alignedObj.baseSize = t_baseSize;
-    Object& obj = alignedObj.sizes[t_size];
-    ++obj.current;
-    obj.peak = std::max(obj.peak, obj.current);
-    obj.function = t_funcName;
-    if (t_baseSize != 0) {
-        obj.array = t_size / t_baseSize;
+    if (__shardReleased) {
+        return nullptr;
+    }
+    pthread_once(&__shardKeyOnce, []() {
+        // an exiting thread hands its shard over to the next thread
+        pthread_key_create(&__shardKey, [](void* t_shard) {
+            __shard = nullptr;
+            __shardReleased = true;
+            static_cast<Shard*>(t_shard)->inUse.store(
+                false, std::memory_order_release);
+        });
+    });
+    Shard* shard = m_shards.load(std::memory_order_acquire);
+    for (; shard; shard = shard->next) {
+        bool inUse = false;
+        if (!shard->inUse.load(std::memory_order_relaxed) &&
+            shard->inUse.compare_exchange_strong(inUse, true,
+                                                 std::memory_order_acquire)) {
+            break;
+        }
     }
-    m_obj[t_ptr] = &obj;
-    lk.unlock();
+    if (!shard) {
+        shard = systemNew<Shard>();
+        shard->inUse.store(true, std::memory_order_relaxed);
+        shard->next = m_shards.load(std::memory_order_relaxed);
+        while (!m_shards.compare_exchange_weak(shard->next, shard,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+        }
+    }
+    __shard = shard;
+    __shardOwner = this;
+    pthread_setspecific(__shardKey, shard);
+    return shard;
 }
 
-void AllocCollector::removeObject(void* t_ptr) {
-    std::unique_lock<std::mutex> lk(m_mapLock);
-    m_cv.wait(lk, [&](){ return !m_waitingToPrint; });
-    Object* objStat = m_obj[t_ptr];
-    --objStat->current;
-    m_obj.erase(t_ptr);
-    lk.unlock();
+ObjectCounter* AllocCollector::getCounter(Shard* t_shard,
+                                          const CounterKey& t_key,
+                                          size_t t_baseSize) {
+    auto found = t_shard->index.find(t_key);
+    if (found != t_shard->index.end()) {
+        return found->second;
+    }
+    ObjectCounter* counter = systemNew<ObjectCounter>();
+    counter->name = t_key.name;
+    counter->function = t_key.function;
+    counter->size = t_key.size;
+    counter->alignment = t_key.alignment;
+    counter->baseSize = t_baseSize;
+    counter->next = t_shard->counters.load(std::memory_order_relaxed);
+    // the snapshots see the counter once it is complete
+    t_shard->counters.store(counter, std::memory_order_release);
+    t_shard->index.emplace(t_key, counter);
+    return counter;
+}
+
+ObjectCounter* AllocCollector::count(const CounterKey& t_key,
+                                     size_t t_baseSize,
+                                     std::atomic<size_t> ObjectCounter::*
+                                         t_count) {
+    Shard* shard = getShard();
+    std::unique_lock<std::mutex> lk(m_exitedLock, std::defer_lock);
+    if (!shard) {
+        // the thread exits and has handed its shard over already
+        lk.lock();
+        shard = m_exitedShard;
+    }
+    ObjectCounter* counter = getCounter(shard, t_key, t_baseSize);
+    // only one thread writes the counter at a time, so it needs no atomic
+    // increment
+    std::atomic<size_t>& n = counter->*t_count;
+    n.store(n.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return counter;
+}
+
+ObjectCounter* AllocCollector::addObject(size_t t_size, size_t t_align,
+                                         const char* t_name,
+                                         size_t t_baseSize,
+                                         const char* t_funcName) {
+    std::call_once(m_threadStarted, [this]() {
+        m_objectsFile.open("object_snapshots_" + std::to_string(getpid()) +
+                           ".json");
+        m_snapshotThread = std::thread(&AllocCollector::run, this);
+    });
+    return count(CounterKey{t_name, t_funcName, t_size, t_align}, t_baseSize,
+                 &ObjectCounter::allocations);
+}
+
+void AllocCollector::removeObject(ObjectCounter* t_counter) {
+    // the object may have been allocated by another thread, which counts
+    // in another shard
+    count(CounterKey{t_counter->name, t_counter->function, t_counter->size,
+                     t_counter->alignment},
+          t_counter->baseSize, &ObjectCounter::deallocations);
 }
 
 void AllocCollector::takeSnapshot() {
-    m_waitingToPrint = true;
-    std::unique_lock<std::mutex> lk(m_mapLock);
+    std::lock_guard<std::mutex> lk(m_snapshotLock);
+    snapshot();
+}
+
+void AllocCollector::snapshot() {
     // allocObj -> pair<name, AllocatedObject>
-    for (const auto& allocObj : m_allocObj) {
+    for (auto& allocObj : m_allocObj) {
         // alignedObj -> pair<alignment, AlignedObject>
-        for (const auto& alignedObj : allocObj.second.alignments) {
+        for (auto& alignedObj : allocObj.second.alignments) {
             // obj -> pair<size, Object>
+            for (auto& obj : alignedObj.second.sizes) {
+                obj.second.current = 0;
+            }
+        }
+    }
+    // the deallocations of an object may be counted before its allocation
+    // is, so the totals are signed until all the shards are added
+    std::map<Object*, long long, std::less<Object*>,
+             mallocator<std::pair<Object* const, long long>>> totals;
+    Shard* shard = m_shards.load(std::memory_order_acquire);
+    for (; shard; shard = shard->next) {
+        ObjectCounter* counter =
+            shard->counters.load(std::memory_order_acquire);
+        for (; counter; counter = counter->next) {
+            AlignedObject& alignedObj =
+                m_allocObj[counter->name].alignments[counter->alignment];
+            alignedObj.baseSize = counter->baseSize;
+            Object& obj = alignedObj.sizes[counter->size];
+            obj.function = counter->function;
+            if (counter->baseSize != 0) {
+                obj.array = counter->size / counter->baseSize;
+            }
+            totals[&obj] +=
+                counter->allocations.load(std::memory_order_relaxed);
+            totals[&obj] -=
+                counter->deallocations.load(std::memory_order_relaxed);
+        }
+    }
+    for (const auto& total : totals) {
+        total.first->current = std::max(total.second, 0ll);
+        total.first->peak = std::max(total.first->peak,
+                                     total.first->current);
+    }
+    for (const auto& allocObj : m_allocObj) {
+        for (const auto& alignedObj : allocObj.second.alignments) {
             for (const auto& obj : alignedObj.second.sizes) {
                 auto& entry = m_snapshots[m_snapshotCount][allocObj.first]
                     [std::to_string(alignedObj.first)]
@@ -73,15 +202,13 @@ void AllocCollector::takeSnapshot() {
         }
     }
     ++m_snapshotCount;
-    m_waitingToPrint = false;
-    lk.unlock();
-    m_cv.notify_one();
 }
 
 void AllocCollector::run() {
-    while (true) {
-        takeSnapshot();
-        std::chrono::milliseconds timespan(100);
-        std::this_thread::sleep_for(timespan);
+    std::unique_lock<std::mutex> lk(m_snapshotLock);
+    while (!m_stopping) {
+        snapshot();
+        m_cv.wait_for(lk, std::chrono::milliseconds(100),
+                      [this]() { return m_stopping; });
     }
 }
@@ -1,7 +1,9 @@
 #ifndef __ALLOC_COLLECTOR_H__
 #define __ALLOC_COLLECTOR_H__
 
+#include <atomic>
 #include <map>
+#include <unordered_map>
 #include <fstream> // ofstream
 #include <mutex>
 #include <condition_variable>
@@ -19,6 +21,19 @@
  * When the object dies, the snapshots are written to a file called
  * `object_snapshots_<PID>`.
  * @par
+ * Every thread counts its allocations and deallocations in a shard of its
+ * own (see `ObjectCounter`), so they take no lock and never wait for
+ * a snapshot, which adds up the counters of all the shards. The shard of
+ * a thread that exits is reused by the next thread that starts. The
+ * allocations that a thread makes after it handed its shard over (e.g. in
+ * the destructors of its thread-specific data) are counted in a shard that
+ * is shared by the exiting threads and guarded by a lock. As the
+ * shards are read while they change, the "peak" of a snapshot is the
+ * highest number of objects that was seen by a snapshot.
+ * @par
+ * Only a single AllocCollector may count allocations at a time, and its
+ * shards are not freed when it is destroyed.
+ * @par
  * An example JSON which represents a snapshot:
  * ```
  * ...
@@ -52,22 +67,24 @@ class AllocCollector {
 public:
     AllocCollector();
     /**
-     * Adds an allocation's metadata to the list of allocated objects.
+     * Counts an allocation.
      * @param t_size the size of the allocation
      * @param t_align the alignment of the allocation
      * @param t_name the name of the type allocated
      * @param t_baseSize the sizeof of the type allocated
      * @param t_funcName the name of the function which allocated the type
-     * @param t_ptr the pointer to the allocated type
+     * @return the counter of the allocation, which is passed to
+     *         `removeObject` when the object is deallocated
      */
-    void addObject(size_t t_size, size_t t_align,
-                   const char* t_name, size_t t_baseSize,
-                   const char* t_funcName, void* t_ptr);
+    ObjectCounter* addObject(size_t t_size, size_t t_align,
+                             const char* t_name, size_t t_baseSize,
+                             const char* t_funcName);
     /**
-     * Removes the given allocated type.
-     * @param t_ptr the pointer to the allocated type
+     * Counts the deallocation of an object.
+     * @param t_counter the counter that `addObject` returned for the object,
+     *                  which may belong to another thread
      */
-    void removeObject(void* t_ptr);
+    void removeObject(ObjectCounter* t_counter);
     /**
      * Records the state of allocations in a JSON.
      */
@@ -77,18 +94,75 @@ private:
     using json = nlohmann::basic_json<std::map, std::vector, std::string,
                                   bool, std::int64_t, std::uint64_t,
                                   double, mallocator>;
+
+    struct CounterKey {
+        const char* name;
+        const char* function;
+        size_t size;
+        size_t alignment;
+
+        bool operator==(const CounterKey& t_other) const {
+            return name == t_other.name && function == t_other.function &&
+                size == t_other.size && alignment == t_other.alignment;
+        }
+    };
+
+    struct CounterKeyHash {
+        size_t operator()(const CounterKey& t_key) const {
+            size_t hash = std::hash<const void*>()(t_key.name);
+            hash = hash * 31 + std::hash<const void*>()(t_key.function);
+            hash = hash * 31 + t_key.size;
+            return hash * 31 + t_key.alignment;
+        }
+    };
+
+    /**
+     * The counters of a thread. Only the thread reads the index, while the
+     * snapshots read the list of counters.
+     */
+    struct Shard {
+        std::atomic<ObjectCounter*> counters;
+        std::unordered_map<CounterKey, ObjectCounter*, CounterKeyHash,
+                           std::equal_to<CounterKey>,
+                           mallocator<std::pair<const CounterKey,
+                                                ObjectCounter*>>> index;
+        std::atomic<bool> inUse;
+        Shard* next;
+    };
+
     std::ofstream m_objectsFile;
+    /** The shards of all the threads, which are never freed. */
+    std::atomic<Shard*> m_shards;
+    /** The shard of the threads that have handed their shards over. */
+    Shard* m_exitedShard;
+    std::mutex m_exitedLock;
+    /** The totals of the snapshots, which keep the peaks between them. */
     std::map<std::string, AllocatedObject, std::less<std::string>,
              mallocator<std::pair<const std::string, AllocatedObject>>> m_allocObj;
-    std::map<void*, Object*, std::less<void*>,
-             mallocator<std::pair<const void*, Object*>>> m_obj;
     json m_snapshots;
-    std::mutex m_mapLock;
+    /** Guards the snapshots, which are taken by the snapshot thread. */
+    std::mutex m_snapshotLock;
     std::condition_variable m_cv;
     std::thread m_snapshotThread;
+    std::once_flag m_threadStarted;
     size_t m_snapshotCount = 0;
-    bool m_waitingToPrint = false, m_threadStarted = false;
+    bool m_stopping = false;
 
+    /**
+     * @return the shard of the calling thread or nullptr if the thread
+     *         exits and has handed its shard over.
+     */
+    Shard* getShard();
+    ObjectCounter* getCounter(Shard* t_shard, const CounterKey& t_key,
+                              size_t t_baseSize);
+    /**
+     * Increments `t_count` of the counter of `t_key` in the shard of the
+     * calling thread.
+     * @return the counter
+     */
+    ObjectCounter* count(const CounterKey& t_key, size_t t_baseSize,
+                         std::atomic<size_t> ObjectCounter::* t_count);
+    void snapshot();
     void run();
 };
 
@@ -1,6 +1,7 @@
 #ifndef __ALLOCATION_OBJECT_H__
 #define __ALLOCATION_OBJECT_H__
 
+#include <atomic>
 #include <cstddef>
 #include <string>
 #include <map>
@@ -30,4 +31,24 @@ struct AllocatedObject {
              mallocator<std::pair<const size_t, AlignedObject>>> alignments;
 };
 
+/**
+ * Counts the objects of a type, size and alignment that are allocated by
+ * a function on a single thread, and the objects of the same kind that
+ * the thread deallocates.
+ * @par
+ * The names are the strings that the pass passes to custom_new, so they
+ * are compared by their addresses. Only the thread writes the counters,
+ * which are atomic so that a snapshot can read them while it runs.
+ */
+struct ObjectCounter {
+    const char* name; // the name of the type allocated
+    const char* function; // the name of the function which allocated it
+    size_t size; // the size of the allocation
+    size_t alignment; // the alignment of the allocation
+    size_t baseSize; // the sizeof of the type allocated
+    std::atomic<size_t> allocations;
+    std::atomic<size_t> deallocations;
+    ObjectCounter* next; // the counter that the thread created before
+};
+
 #endif // __ALLOCATION_OBJECT_H__
@@ -0,0 +1,250 @@
+#include "CpuCaches.hpp"
+
+#include <unistd.h>
+
+#include "rpools/tools/system_alloc.hpp"
+
+#if defined(__x86_64__) && defined(__has_include)
+#if __has_include(<sys/rseq.h>)
+#define RPOOLS_HAS_RSEQ
+#include <sys/rseq.h>
+#endif
+#endif
+
+using rpools::GlobalLinkedPool;
+
+const size_t CpuCaches::CAPACITY;
+const size_t CpuCaches::REFILL_SIZE;
+
+#ifdef RPOOLS_HAS_RSEQ
+namespace {
+    /**
+     *  @return the rseq area which glibc registered for the calling thread.
+     */
+    struct rseq* getRseq() {
+        return reinterpret_cast<struct rseq*>(
+            static_cast<char*>(__builtin_thread_pointer()) + __rseq_offset);
+    }
+
+// The descriptor of a restartable sequence which starts at 1, commits
+// with the last instruction before 2 and restarts at 4.
+// The abort handler must be preceded by RSEQ_SIG.
+#define RPOOLS_RSEQ_SEQUENCE(body)                                  \
+    ".pushsection __rseq_cs, \"aw\"\n\t"                            \
+    ".balign 32\n\t"                                                \
+    "3:\n\t"                                                        \
+    ".long 0x0, 0x0\n\t"                                            \
+    ".quad 1f, (2f - 1f), 4f\n\t"                                   \
+    ".popsection\n\t"                                               \
+    "leaq 3b(%%rip), %%rax\n\t"                                     \
+    "movq %%rax, 8(%[rseq])\n\t"                                    \
+    "1:\n\t"                                                        \
+    /* the slab of the CPU that the thread runs on */               \
+    "movl 4(%[rseq]), %%eax\n\t"                                    \
+    "cmpl %[numOfCpus], %%eax\n\t"                                  \
+    "jae %l[fail]\n\t"                                              \
+    "imulq %[stride], %%rax\n\t"                                    \
+    "addq %[base], %%rax\n\t"                                       \
+    "movq (%%rax), %%rcx\n\t"                                       \
+    body                                                            \
+    "2:\n\t"                                                        \
+    ".pushsection __rseq_failure, \"ax\"\n\t"                       \
+    ".byte 0x0f, 0xb9, 0x3d\n\t"                                    \
+    ".long 0x53053053\n\t"                                          \
+    "4:\n\t"                                                        \
+    "jmp %l[abort]\n\t"                                             \
+    ".popsection\n\t"
+
+    /**
+     *  Pops the top slot of the slab at `t_base + cpu * t_stride`.
+     *  @return 1 if a slot was stored in `t_out`, 0 if the slab is empty
+     *          and -1 if the sequence was aborted.
+     */
+    int rseqPop(struct rseq* t_rseq, char* t_base, size_t t_stride,
+                uint32_t t_numOfCpus, void** t_out) {
+        __asm__ goto(
+            RPOOLS_RSEQ_SEQUENCE(
+                "testq %%rcx, %%rcx\n\t"
+                "jz %l[fail]\n\t"
+                "movq (%%rax, %%rcx, 8), %%rdx\n\t"
+                "movq %%rdx, (%[out])\n\t"
+                "decq %%rcx\n\t"
+                // commit
+                "movq %%rcx, (%%rax)\n\t")
+            :
+            : [rseq] "r" (t_rseq), [base] "r" (t_base),
+              [stride] "r" (t_stride), [numOfCpus] "r" (t_numOfCpus),
+              [out] "r" (t_out)
+            : "memory", "cc", "rax", "rcx", "rdx"
+            : abort, fail);
+        return 1;
+    abort:
+        return -1;
+    fail:
+        return 0;
+    }
+
+    /**
+     *  Pushes `t_ptr` onto the slab at `t_base + cpu * t_stride`.
+     *  @return 1 if the slot was pushed, 0 if the slab is full and -1 if
+     *          the sequence was aborted.
+     */
+    int rseqPush(struct rseq* t_rseq, char* t_base, size_t t_stride,
+                 uint32_t t_numOfCpus, void* t_ptr, size_t t_capacity) {
+        __asm__ goto(
+            RPOOLS_RSEQ_SEQUENCE(
+                "cmpq %[capacity], %%rcx\n\t"
+                "jae %l[fail]\n\t"
+                "movq %[ptr], 8(%%rax, %%rcx, 8)\n\t"
+                "incq %%rcx\n\t"
+                // commit
+                "movq %%rcx, (%%rax)\n\t")
+            :
+            : [rseq] "r" (t_rseq), [base] "r" (t_base),
+              [stride] "r" (t_stride), [numOfCpus] "r" (t_numOfCpus),
+              [ptr] "r" (t_ptr), [capacity] "r" (t_capacity)
+            : "memory", "cc", "rax", "rcx"
+            : abort, fail);
+        return 1;
+    abort:
+        return -1;
+    fail:
+        return 0;
+    }
+}
+#endif
+
+CpuCaches::CpuCaches(size_t t_numOfClasses)
+    : m_numOfClasses(t_numOfClasses),
+      m_numOfCpus(0),
+      m_slabs(nullptr) {
+#ifdef RPOOLS_HAS_RSEQ
+    // glibc does not register rseq if the kernel does not support it or if
+    // it is disabled with the glibc.pthread.rseq tunable
+    long numOfCpus = sysconf(_SC_NPROCESSORS_CONF);
+    if (__rseq_size == 0 || numOfCpus <= 0) {
+        return;
+    }
+    m_numOfCpus = numOfCpus;
+    // calloc-ed memory is a valid array of empty slabs
+    m_slabs = static_cast<Slab*>(rpools::systemCalloc(
+        m_numOfCpus * m_numOfClasses, sizeof(Slab)));
+#endif
+}
+
+CpuCaches::~CpuCaches() {
+    rpools::systemFree(m_slabs);
+}
+
+void* CpuCaches::allocate(size_t t_class, GlobalLinkedPool& t_pool) {
+    void* ptr = nullptr;
+    if (pop(t_class, &ptr)) {
+        return ptr;
+    }
+    if (!isRegistered()) {
+        return t_pool.allocate();
+    }
+    // refill the cache of the current CPU
+    void* slots[REFILL_SIZE];
+    size_t allocated = t_pool.allocateBulk(slots, REFILL_SIZE);
+    if (allocated == 0) {
+        return nullptr;
+    }
+    size_t pushed = 1;
+    while (pushed < allocated && push(t_class, slots[pushed])) {
+        ++pushed;
+    }
+    // the thread may have moved to a CPU whose cache is full
+    t_pool.deallocateBulk(slots + pushed, allocated - pushed);
+    return slots[0];
+}
+
+void CpuCaches::deallocate(size_t t_class, GlobalLinkedPool& t_pool,
+                           void* t_ptr) {
+    if (push(t_class, t_ptr)) {
+        return;
+    }
+    if (!isRegistered()) {
+        t_pool.deallocate(t_ptr);
+        return;
+    }
+    // the cache of the current CPU is full, so half of it is moved back
+    // to the pool
+    void* slots[REFILL_SIZE];
+    size_t popped = 0;
+    while (popped < REFILL_SIZE && pop(t_class, &slots[popped])) {
+        ++popped;
+    }
+    t_pool.deallocateBulk(slots, popped);
+    if (!push(t_class, t_ptr)) {
+        t_pool.deallocate(t_ptr);
+    }
+}
+
+void CpuCaches::flush(size_t t_class, GlobalLinkedPool& t_pool) {
+    void* slots[REFILL_SIZE];
+    size_t popped;
+    do {
+        popped = 0;
+        while (popped < REFILL_SIZE && pop(t_class, &slots[popped])) {
+            ++popped;
+        }
+        t_pool.deallocateBulk(slots, popped);
+    } while (popped == REFILL_SIZE);
+}
+
+bool CpuCaches::moveToCpu(uint32_t t_cpu) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(t_cpu, &cpus);
+    // the kernel migrates the calling thread before it returns
+    return sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+}
+
+bool CpuCaches::isRegistered() const {
+#ifdef RPOOLS_HAS_RSEQ
+    return m_slabs && getRseq()->cpu_id < m_numOfCpus;
+#else
+    return false;
+#endif
+}
+
+bool CpuCaches::pop(size_t t_class, void** t_out) {
+#ifdef RPOOLS_HAS_RSEQ
+    if (!m_slabs) {
+        return false;
+    }
+    auto base = reinterpret_cast<char*>(m_slabs + t_class);
+    size_t stride = m_numOfClasses * sizeof(Slab);
+    int result;
+    // an aborted sequence is restarted on the CPU the thread runs on now
+    do {
+        result = rseqPop(getRseq(), base, stride, m_numOfCpus, t_out);
+    } while (result < 0);
+    return result != 0;
+#else
+    (void)t_class;
+    (void)t_out;
+    return false;
+#endif
+}
+
+bool CpuCaches::push(size_t t_class, void* t_ptr) {
+#ifdef RPOOLS_HAS_RSEQ
+    if (!m_slabs) {
+        return false;
+    }
+    auto base = reinterpret_cast<char*>(m_slabs + t_class);
+    size_t stride = m_numOfClasses * sizeof(Slab);
+    int result;
+    do {
+        result = rseqPush(getRseq(), base, stride, m_numOfCpus, t_ptr,
+                          CAPACITY);
+    } while (result < 0);
+    return result != 0;
+#else
+    (void)t_class;
+    (void)t_ptr;
+    return false;
+#endif
+}
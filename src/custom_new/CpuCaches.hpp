@@ -0,0 +1,134 @@
+#ifndef __CPU_CACHES_H__
+#define __CPU_CACHES_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <sched.h>
+
+#include "rpools/allocators/GlobalLinkedPool.hpp"
+#include "rpools/allocators/SlotCache.hpp"
+
+/**
+ *  Represents a stack of free slots for every CPU and every size class,
+ *  which sits in front of the `GlobalLinkedPool`s of `GlobalPools`.
+ *  @par
+ *  The stack of the current CPU is popped and pushed inside Linux
+ *  restartable sequences (rseq), so no atomics or locks are needed: the
+ *  kernel restarts a sequence if the thread is preempted or migrated
+ *  before the commit. Unlike thread caches, the memory of the caches does
+ *  not grow with the number of threads.
+ *  @par
+ *  rseq is only used on x86_64 when glibc registers the rseq area of every
+ *  thread (glibc 2.35 or newer). Otherwise `isEnabled` returns false and
+ *  the pools must be used directly.
+ */
+class CpuCaches {
+public:
+    /** The maximum number of slots that are cached per CPU and class. */
+    static const size_t CAPACITY = rpools::SlotCache::CAPACITY;
+    /** The number of slots that are moved between a cache and a pool. */
+    static const size_t REFILL_SIZE = rpools::SlotCache::REFILL_SIZE;
+
+    /**
+     *  @param t_numOfClasses the number of size classes
+     */
+    explicit CpuCaches(size_t t_numOfClasses);
+
+    CpuCaches(const CpuCaches&) = delete;
+    CpuCaches& operator=(const CpuCaches&) = delete;
+
+    ~CpuCaches();
+
+    /**
+     *  @return true if rseq is available and the caches could be allocated.
+     */
+    bool isEnabled() const { return m_slabs != nullptr; }
+
+    /**
+     *  Allocates a slot from the cache of the current CPU, which is refilled
+     *  from `t_pool` when it is empty.
+     *  @param t_class the size class of `t_pool`
+     *  @param t_pool the pool of the size class
+     *  @return a pointer to a free slot or nullptr if allocation failed.
+     */
+    void* allocate(size_t t_class, rpools::GlobalLinkedPool& t_pool);
+
+    /**
+     *  Caches a slot on the current CPU, half of the cache is returned to
+     *  `t_pool` when it is full.
+     *  @param t_class the size class of `t_pool`
+     *  @param t_pool the pool of the size class
+     *  @param t_ptr the slot that is deallocated
+     */
+    void deallocate(size_t t_class, rpools::GlobalLinkedPool& t_pool,
+                    void* t_ptr);
+
+    /**
+     *  Returns all the slots cached by the current CPU to `t_pool`.
+     *  @note The caches of the other CPUs are left untouched, see
+     *        `forEachCpu` to reach them.
+     */
+    void flush(size_t t_class, rpools::GlobalLinkedPool& t_pool);
+
+    /**
+     *  Calls `t_f` once on every CPU that the calling thread may run on, by
+     *  moving the thread to each of them in turn, so that `flush` drains
+     *  the caches of all those CPUs. The CPU affinity of the thread is
+     *  restored afterwards.
+     *  @note The caches of CPUs that the thread may not run on (e.g. CPUs
+     *        outside of its cpuset) are left untouched. Without rseq, `t_f`
+     *        is called once on the current CPU.
+     */
+    template <typename F>
+    void forEachCpu(F t_f) {
+        cpu_set_t allowed;
+        if (!isEnabled() ||
+            sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+            t_f();
+            return;
+        }
+        for (uint32_t cpu = 0; cpu < m_numOfCpus && cpu < CPU_SETSIZE;
+             ++cpu) {
+            if (CPU_ISSET(cpu, &allowed) && moveToCpu(cpu)) {
+                t_f();
+            }
+        }
+        sched_setaffinity(0, sizeof(allowed), &allowed);
+    }
+
+private:
+    /** The cache of a size class on a CPU. */
+    struct Slab {
+        size_t count;
+        void* slots[CAPACITY];
+    };
+
+    const size_t m_numOfClasses;
+    uint32_t m_numOfCpus;
+    Slab* m_slabs;
+
+    /**
+     *  @return true if the calling thread can use the caches.
+     */
+    bool isRegistered() const;
+
+    /**
+     *  Makes the calling thread run only on CPU `t_cpu`.
+     *  @return true if the thread runs on `t_cpu` now.
+     */
+    bool moveToCpu(uint32_t t_cpu);
+
+    /**
+     *  Pops a slot from the cache of `t_class` on the current CPU.
+     *  @return false if the cache is empty.
+     */
+    bool pop(size_t t_class, void** t_out);
+
+    /**
+     *  Pushes a slot onto the cache of `t_class` on the current CPU.
+     *  @return false if the cache is full.
+     */
+    bool push(size_t t_class, void* t_ptr);
+};
+
+#endif // __CPU_CACHES_H__
@@ -1,27 +1,187 @@
 #include "GlobalPools.hpp"
 
 #include <cstddef>
-#include <cmath>
+#include <cstdlib>
+
+#include "ReentrancyGuard.hpp"
+#include "rpools/tools/PageProvider.hpp"
+#include "rpools/tools/system_alloc.hpp"
 
 using std::vector;
 using rpools::GlobalLinkedPool;
+using rpools::ReentrancyGuard;
+using rpools::SlotCache;
+using rpools::systemCalloc;
+using rpools::systemFree;
+using rpools::systemMalloc;
 
 const size_t __void = sizeof(void*);
-const size_t __logOfVoid = std::log2(__void);
 
-GlobalPools::GlobalPools(size_t t_numOfPools)
-    : m_pools() {
-    m_pools.reserve(t_numOfPools);
-    for (size_t i = __void; i <= t_numOfPools * __void; i += __void) {
-        size_t alignment = (i & (alignof(max_align_t) - 1)) == 0 ?
+#ifdef RPOOLS_MALLOC_INTERPOSITION
+__thread bool rpools::__inPools __attribute__((tls_model("initial-exec"))) =
+    false;
+#endif
+
+namespace {
+    /**
+     *  Whether the `ThreadCache` of the calling thread has been destroyed,
+     *  after which the thread (which is exiting) uses the pools directly.
+     */
+    __thread bool __cacheDestroyed __attribute__((tls_model("initial-exec")))
+        = false;
+}
+
+const size_t GlobalPools::MIN_SLOTS_PER_POOL;
+GlobalPools* GlobalPools::s_forkPools = nullptr;
+
+GlobalPools::GlobalPools()
+    : m_pools(),
+      m_maxSize(0)
+#ifdef RPOOLS_PERCPU_CACHES
+      , m_cpuCaches(rpools::NUM_SIZE_CLASSES)
+#endif
+      {
+    m_pools.reserve(rpools::NUM_SIZE_CLASSES);
+    for (size_t i = 0; i < rpools::NUM_SIZE_CLASSES; ++i) {
+        size_t size = rpools::getSizeClassSize(i);
+        size_t alignment = (size & (alignof(max_align_t) - 1)) == 0 ?
             alignof(max_align_t) : __void;
-        m_pools.emplace_back(i, alignment);
+        m_pools.emplace_back(size, alignment);
+        // the classes only get bigger, so the rest are left to malloc too
+        if (m_pools.back().value.getPoolSize() < MIN_SLOTS_PER_POOL) {
+            m_pools.pop_back();
+            break;
+        }
+        m_maxSize = size;
     }
+    pthread_key_create(&m_cacheKey, &GlobalPools::destroyThreadCache);
+    s_forkPools = this;
+    static bool registered = pthread_atfork(&GlobalPools::lockForFork,
+                                            &GlobalPools::unlockAfterFork,
+                                            &GlobalPools::unlockAfterFork)
+        == 0;
+    (void)registered;
+}
+
+GlobalPools::~GlobalPools() {
+    if (s_forkPools == this) {
+        s_forkPools = nullptr;
+    }
+    pthread_key_delete(m_cacheKey);
 }
 
 GlobalLinkedPool& GlobalPools::getPool(size_t t_size) {
-    if (t_size == 0) {
-        return m_pools[0];
+    return m_pools[getIndex(t_size)].value;
+}
+
+void* GlobalPools::allocate(size_t t_size) {
+    size_t index = getIndex(t_size);
+#ifdef RPOOLS_PERCPU_CACHES
+    if (m_cpuCaches.isEnabled()) {
+        return m_cpuCaches.allocate(index, m_pools[index].value);
+    }
+    return m_pools[index].value.allocate();
+#else
+    ThreadCache* tc = getThreadCache();
+    if (!tc) {
+        return m_pools[index].value.allocate();
+    }
+    return tc->caches[index].allocate(m_pools[index].value);
+#endif
+}
+
+void GlobalPools::deallocate(void* t_ptr, size_t t_size) {
+    size_t index = getIndex(t_size);
+#ifdef RPOOLS_PERCPU_CACHES
+    if (m_cpuCaches.isEnabled()) {
+        m_cpuCaches.deallocate(index, m_pools[index].value, t_ptr);
+    } else {
+        m_pools[index].value.deallocate(t_ptr);
+    }
+#else
+    ThreadCache* tc = getThreadCache();
+    if (!tc) {
+        m_pools[index].value.deallocate(t_ptr);
+    } else {
+        tc->caches[index].deallocate(m_pools[index].value, t_ptr);
+    }
+#endif
+}
+
+void GlobalPools::flushThreadCache() {
+#ifdef RPOOLS_PERCPU_CACHES
+    m_cpuCaches.forEachCpu([this]() {
+        for (size_t i = 0; i < m_pools.size(); ++i) {
+            m_cpuCaches.flush(i, m_pools[i].value);
+        }
+    });
+#endif
+    auto tc = static_cast<ThreadCache*>(pthread_getspecific(m_cacheKey));
+    if (tc) {
+        for (size_t i = 0; i < m_pools.size(); ++i) {
+            tc->caches[i].flush(m_pools[i].value);
+        }
+    }
+}
+
+size_t GlobalPools::getIndex(size_t t_size) const {
+    return rpools::getSizeClass(t_size);
+}
+
+GlobalPools::ThreadCache* GlobalPools::getThreadCache() {
+    auto tc = static_cast<ThreadCache*>(pthread_getspecific(m_cacheKey));
+    if (tc || __cacheDestroyed) {
+        return tc;
+    }
+    tc = static_cast<ThreadCache*>(systemMalloc(sizeof(ThreadCache)));
+    if (!tc) {
+        return nullptr;
+    }
+    tc->owner = this;
+    // calloc-ed memory is a valid array of empty SlotCaches
+    tc->caches = static_cast<SlotCache*>(systemCalloc(m_pools.size(),
+                                                  sizeof(SlotCache)));
+    if (!tc->caches || pthread_setspecific(m_cacheKey, tc) != 0) {
+        systemFree(tc->caches);
+        systemFree(tc);
+        return nullptr;
+    }
+    return tc;
+}
+
+void GlobalPools::destroyThreadCache(void* t_cache) {
+    // the pools may call malloc while they hold a lock (e.g. the AVL index),
+    // which must not re-enter them
+    ReentrancyGuard guard;
+    __cacheDestroyed = true;
+    auto tc = static_cast<ThreadCache*>(t_cache);
+    GlobalPools* pools = tc->owner;
+    for (size_t i = 0; i < pools->m_pools.size(); ++i) {
+        tc->caches[i].flush(pools->m_pools[i].value);
+    }
+    systemFree(tc->caches);
+    systemFree(tc);
+}
+
+void GlobalPools::lockForFork() {
+    if (!s_forkPools) {
+        return;
+    }
+    for (auto& entry : s_forkPools->m_pools) {
+        entry.value.lockForFork();
+    }
+    rpools::lockArenasForFork();
+}
+
+void GlobalPools::unlockAfterFork() {
+    if (!s_forkPools) {
+        return;
+    }
+    // releasing a pool may drain remote frees, which give pools back to
+    // the arenas and may call malloc while the next pools are still locked
+    ReentrancyGuard guard;
+    rpools::unlockArenasAfterFork();
+    for (auto& entry : s_forkPools->m_pools) {
+        entry.value.unlockAfterFork();
     }
-    return m_pools[(t_size >> __logOfVoid) - 1];
 }
@@ -2,37 +2,138 @@
 #define __GLOBAL_POOLS_H__
 
 #include <vector>
+#include <pthread.h>
 
+#include "rpools/tools/CacheAligned.hpp"
 #include "rpools/tools/mallocator.hpp"
 #include "rpools/allocators/GlobalLinkedPool.hpp"
+#include "rpools/allocators/SlotCache.hpp"
+#include "rpools/custom_new/SizeClasses.hpp"
+#ifdef RPOOLS_PERCPU_CACHES
+#include "CpuCaches.hpp"
+#endif
 
 /**
- *  Represents a class which holds `GlobalLinkedPool`s that can
- *  hold objects that are multiples of 8.
+ *  Represents a class which holds a `GlobalLinkedPool` for every size class
+ *  (see SizeClasses.hpp).
  *  @par
- *  Example: GlobalPools(8) will create 8 `GlobalLinkedPool`s.
- *  The first pool can hold objects of sizes up to 8 and will align them
- *  at 8 byte boundaries. The 2nd pool will hold objects of size 16, but will
- *  align them at 16 byte boundaries, and so on.
+ *  The pool of a class whose size is a multiple of 16 aligns its objects at
+ *  16 byte boundaries, the other pools align them at 8 byte boundaries.
+ *  A class only gets a pool if at least `MIN_SLOTS_PER_POOL` of its objects
+ *  fit in a pool, so the biggest classes are left to malloc when the pools
+ *  are small (see `getPoolSpan`).
+ *  @par
+ *  Every pool sits on its own cache lines, so that threads which use
+ *  neighbouring size classes do not contend for the line of a lock.
+ *  @par
+ *  Every thread gets a `SlotCache` for each pool so that most (de)allocations
+ *  do not need to take the lock of a `GlobalLinkedPool`. The caches of a
+ *  thread are flushed back to the pools when the thread exits, and the
+ *  (de)allocations that it makes after that use the pools directly.
+ *  @par
+ *  When built with `RPOOLS_PERCPU_CACHES`, the slots are cached per CPU
+ *  instead (see `CpuCaches`). If rseq is not available, the pools are
+ *  used directly.
+ *  @par
+ *  The locks of the pools and of the arenas (see PageProvider.hpp) are
+ *  taken while the process forks, so that a child does not wait forever
+ *  on a lock that a thread of its parent held.
  */
 class GlobalPools {
 public:
+    /** The minimum number of objects of a size class that fit in a pool. */
+    static const size_t MIN_SLOTS_PER_POOL = 4;
+
     /**
-     *  Allocates `t_numOfPools` pools.
-     *  @param t_numOfPools the number of `GlobalLinkedPool`s to allocate
+     *  Allocates a pool for every size class up to `MAX_SIZE_CLASS`
+     *  that holds at least `MIN_SLOTS_PER_POOL` objects.
      */
-    GlobalPools(size_t t_numOfPools);
+    GlobalPools();
 
     /**
-     *  Gets the `GlobalLinkedPool` that can hold objects of sizes up to
-     *  `t_size * 8`.
+     *  Gets the `GlobalLinkedPool` of the smallest size class that can hold
+     *  objects of size `t_size`.
      */
     rpools::GlobalLinkedPool& getPool(size_t t_size);
-    virtual ~GlobalPools() = default;
+
+    /**
+     *  @return the size of the biggest class that has a pool.
+     */
+    size_t getMaxSize() const { return m_maxSize; }
+
+    /**
+     *  Allocates a slot from the calling thread's (or CPU's) cache of the
+     *  pool that
+     *  holds objects of size `t_size`.
+     *  @param t_size the size of the object, at most `getMaxSize()`
+     *  @return a pointer to the slot or nullptr if allocation failed.
+     */
+    void* allocate(size_t t_size);
+
+    /**
+     *  Deallocates a slot into the calling thread's (or CPU's) cache of the
+     *  pool that
+     *  holds objects of size `t_size`.
+     *  @param t_ptr the slot that is deallocated
+     *  @param t_size the size of the slot (see `PoolHeaderG::sizeOfSlot`)
+     */
+    void deallocate(void* t_ptr, size_t t_size);
+
+    /**
+     *  Returns all the slots cached by the calling thread (or by every CPU
+     *  that it may run on, see `CpuCaches::forEachCpu`) to their pools.
+     */
+    void flushThreadCache();
+
+    virtual ~GlobalPools();
 private:
-    std::vector<rpools::GlobalLinkedPool,
-                mallocator<rpools::GlobalLinkedPool>
-    > m_pools;
+    /** The `SlotCache`s of a thread, one for every pool. */
+    struct ThreadCache {
+        GlobalPools* owner;
+        rpools::SlotCache* caches;
+    };
+
+    using Entry = rpools::CacheAligned<rpools::GlobalLinkedPool>;
+
+    std::vector<Entry, mallocator<Entry>> m_pools;
+    size_t m_maxSize;
+    pthread_key_t m_cacheKey;
+#ifdef RPOOLS_PERCPU_CACHES
+    CpuCaches m_cpuCaches;
+#endif
+
+    /**
+     *  @return the index in `m_pools` of the pool which holds objects
+     *          of size `t_size`.
+     */
+    size_t getIndex(size_t t_size) const;
+
+    /**
+     *  @return the `ThreadCache` of the calling thread, which is created
+     *          if needed, or nullptr if it could not be created or the
+     *          thread's cache has already been destroyed as it exits.
+     */
+    ThreadCache* getThreadCache();
+
+    /**
+     *  Flushes and frees a `ThreadCache` when its thread exits.
+     */
+    static void destroyThreadCache(void* t_cache);
+
+    /** The pools whose locks are taken when the process forks. */
+    static GlobalPools* s_forkPools;
+
+    /**
+     *  Takes the lock of every pool and then the locks of the arenas, which
+     *  a pool may take while it holds its own, before the process forks.
+     */
+    static void lockForFork();
+
+    /**
+     *  Releases the locks taken by `lockForFork` in the reverse order,
+     *  in the parent and in the child.
+     */
+    static void unlockAfterFork();
 };
 
 #endif // __GLOBAL_POOLS_H__
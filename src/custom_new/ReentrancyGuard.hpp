@@ -0,0 +1,34 @@
+#ifndef __REENTRANCY_GUARD_H__
+#define __REENTRANCY_GUARD_H__
+
+namespace rpools {
+
+#ifdef RPOOLS_MALLOC_INTERPOSITION
+/** Whether the calling thread is inside the pools (see GlobalPools.cpp). */
+extern __thread bool __inPools __attribute__((tls_model("initial-exec")));
+#endif
+
+/**
+ *  Marks the calling thread as being inside the pools while it exists.
+ *  @par
+ *  With `RPOOLS_MALLOC_INTERPOSITION`, malloc is served by the pools,
+ *  so a malloc call made by the pools themselves (e.g. by pthread or by
+ *  the AVL index) must not re-enter them. Otherwise this does nothing.
+ */
+class ReentrancyGuard {
+public:
+#ifdef RPOOLS_MALLOC_INTERPOSITION
+    ReentrancyGuard() : m_reentrant(__inPools) { __inPools = true; }
+    ~ReentrancyGuard() { __inPools = m_reentrant; }
+    bool isReentrant() const { return m_reentrant; }
+private:
+    bool m_reentrant;
+#else
+    ReentrancyGuard() {}
+    bool isReentrant() const { return false; }
+#endif
+};
+
+}
+
+#endif // __REENTRANCY_GUARD_H__
@@ -0,0 +1,271 @@
+#include "TraceRecorder.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "rpools/tools/system_alloc.hpp"
+
+using rpools::TraceHeader;
+using rpools::TraceOp;
+using rpools::TraceRecord;
+using rpools::systemFree;
+using rpools::systemMalloc;
+
+const size_t TraceRecorder::BUFFER_RECORDS;
+std::atomic<int> TraceRecorder::s_state(TraceRecorder::UNKNOWN);
+
+namespace {
+    /** The time the background thread sleeps between two writes. */
+    const long WRITE_INTERVAL_NANOS = 10 * 1000 * 1000;
+
+    struct Buffer {
+        Buffer* next;
+        /** The recording that the records belong to. */
+        size_t generation;
+        size_t count;
+        TraceRecord records[TraceRecorder::BUFFER_RECORDS];
+    };
+
+    /** The buffers that are waiting to be written, the newest first. */
+    std::atomic<Buffer*> __full(nullptr);
+    /** Incremented by every recording, so that old buffers are dropped. */
+    std::atomic<size_t> __generation(0);
+    std::atomic<uint16_t> __numOfThreads(0);
+    std::atomic<bool> __writing(false);
+    int __fd = -1;
+    uint64_t __startNanos = 0;
+    pthread_t __writer;
+    pthread_key_t __bufferKey;
+    pthread_once_t __bufferKeyOnce = PTHREAD_ONCE_INIT;
+
+    __thread Buffer* __buffer __attribute__((tls_model("initial-exec"))) =
+        nullptr;
+    __thread int __threadNumber __attribute__((tls_model("initial-exec"))) =
+        -1;
+    /** Whether the calling thread has handed its last buffer over. */
+    __thread bool __finished __attribute__((tls_model("initial-exec"))) =
+        false;
+
+    uint64_t nowNanos() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    void writeAll(int t_fd, const void* t_data, size_t t_size) {
+        const char* data = static_cast<const char*>(t_data);
+        while (t_size > 0) {
+            ssize_t written = write(t_fd, data, t_size);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return;
+            }
+            data += written;
+            t_size -= written;
+        }
+    }
+
+    void push(Buffer* t_buffer) {
+        t_buffer->next = __full.load(std::memory_order_relaxed);
+        while (!__full.compare_exchange_weak(t_buffer->next, t_buffer,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed)) {
+        }
+    }
+
+    /**
+     *  Writes the full buffers of the current recording in the order in
+     *  which they were pushed and frees all of them.
+     */
+    void writeFull() {
+        Buffer* list = __full.exchange(nullptr, std::memory_order_acquire);
+        Buffer* ordered = nullptr;
+        while (list) {
+            Buffer* next = list->next;
+            list->next = ordered;
+            ordered = list;
+            list = next;
+        }
+        size_t generation = __generation.load(std::memory_order_relaxed);
+        while (ordered) {
+            Buffer* next = ordered->next;
+            if (ordered->generation == generation && __fd >= 0) {
+                writeAll(__fd, ordered->records,
+                         ordered->count * sizeof(TraceRecord));
+            }
+            systemFree(ordered);
+            ordered = next;
+        }
+    }
+
+    void* writeLoop(void*) {
+        timespec interval = {0, WRITE_INTERVAL_NANOS};
+        while (__writing.load(std::memory_order_acquire)) {
+            writeFull();
+            nanosleep(&interval, nullptr);
+        }
+        writeFull();
+        return nullptr;
+    }
+
+    /**
+     *  Hands the buffer of an exiting thread to the writer.
+     */
+    void releaseBuffer(void* t_buffer) {
+        Buffer* buffer = static_cast<Buffer*>(t_buffer);
+        // the records of later destructors would go to a buffer that is
+        // never written
+        __finished = true;
+        __buffer = nullptr;
+        if (buffer->count > 0 && TraceRecorder::isRecording()) {
+            push(buffer);
+        } else {
+            systemFree(buffer);
+        }
+    }
+
+    void createBufferKey() {
+        pthread_key_create(&__bufferKey, releaseBuffer);
+    }
+
+    /**
+     *  Makes `t_buffer` the buffer of the calling thread.
+     */
+    void setBuffer(Buffer* t_buffer, size_t t_generation) {
+        if (t_buffer) {
+            t_buffer->generation = t_generation;
+            t_buffer->count = 0;
+        }
+        // the buffer is usable before pthread_setspecific, which may
+        // allocate
+        __buffer = t_buffer;
+        pthread_setspecific(__bufferKey, t_buffer);
+    }
+}
+
+void TraceRecorder::record(TraceOp t_op, void* t_ptr, size_t t_size,
+                           size_t t_alignment) {
+    if (__finished) {
+        return;
+    }
+    size_t generation = __generation.load(std::memory_order_relaxed);
+    Buffer* buffer = __buffer;
+    if (!buffer) {
+        setBuffer(static_cast<Buffer*>(systemMalloc(sizeof(Buffer))),
+                  generation);
+        buffer = __buffer;
+        if (!buffer) {
+            return;
+        }
+    } else if (buffer->generation != generation) {
+        // the records of an earlier recording
+        buffer->generation = generation;
+        buffer->count = 0;
+    }
+    if (__threadNumber < 0) {
+        __threadNumber = __numOfThreads.fetch_add(1);
+    }
+    TraceRecord& record = buffer->records[buffer->count];
+    record.timestamp = nowNanos() - __startNanos;
+    record.objectId = reinterpret_cast<uintptr_t>(t_ptr);
+    record.size = t_size > UINT32_MAX ? UINT32_MAX : t_size;
+    record.thread = __threadNumber;
+    record.alignmentLog2 = __builtin_ctzll(t_alignment);
+    record.op = t_op;
+    if (++buffer->count == BUFFER_RECORDS) {
+        push(buffer);
+        setBuffer(static_cast<Buffer*>(systemMalloc(sizeof(Buffer))),
+                  generation);
+    }
+}
+
+bool TraceRecorder::start(const char* t_path) {
+    int state = s_state.load();
+    do {
+        if (state == RECORDING || state == STARTING) {
+            return state == RECORDING;
+        }
+    } while (!s_state.compare_exchange_weak(state, STARTING));
+    // allocations made while starting are not recorded
+    int fd = open(t_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        s_state.store(OFF);
+        return false;
+    }
+    TraceHeader header;
+    writeAll(fd, &header, sizeof(header));
+    pthread_once(&__bufferKeyOnce, createBufferKey);
+    __fd = fd;
+    __startNanos = nowNanos();
+    __generation.fetch_add(1);
+    __writing.store(true);
+    if (pthread_create(&__writer, nullptr, writeLoop, nullptr) != 0) {
+        close(fd);
+        __fd = -1;
+        s_state.store(OFF);
+        return false;
+    }
+    static bool registered = atexit(stop) == 0 &&
+        pthread_atfork(nullptr, nullptr, stopInChild) == 0;
+    (void)registered;
+    s_state.store(RECORDING, std::memory_order_release);
+    return true;
+}
+
+void TraceRecorder::stop() {
+    int state = RECORDING;
+    if (!s_state.compare_exchange_strong(state, STARTING)) {
+        return;
+    }
+    Buffer* buffer = __buffer;
+    if (buffer && buffer->count > 0 &&
+        buffer->generation == __generation.load()) {
+        push(buffer);
+        setBuffer(nullptr, 0);
+    }
+    __writing.store(false, std::memory_order_release);
+    pthread_join(__writer, nullptr);
+    close(__fd);
+    __fd = -1;
+    s_state.store(OFF);
+}
+
+void TraceRecorder::stopInChild() {
+    // the writer is not forked, so the child would pile up full buffers
+    if (s_state.load(std::memory_order_relaxed) != RECORDING) {
+        return;
+    }
+    s_state.store(OFF);
+    __writing.store(false);
+    // the file is shared with the parent, which still writes to it
+    close(__fd);
+    __fd = -1;
+    // the buffers are copies of the ones that the parent writes
+    Buffer* list = __full.exchange(nullptr);
+    while (list) {
+        Buffer* next = list->next;
+        systemFree(list);
+        list = next;
+    }
+    systemFree(__buffer);
+    setBuffer(nullptr, 0);
+}
+
+int TraceRecorder::startFromEnvironment() {
+    int state = UNKNOWN;
+    if (!s_state.compare_exchange_strong(state, OFF)) {
+        return state;
+    }
+    const char* path = std::getenv("RPOOLS_TRACE");
+    if (path && *path) {
+        start(path);
+    }
+    return s_state.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,82 @@
+#ifndef __TRACE_RECORDER_H__
+#define __TRACE_RECORDER_H__
+
+#include <atomic>
+#include <cstddef>
+
+#include "rpools/custom_new/AllocTrace.hpp"
+
+/**
+ *  Records the allocations and deallocations of `custom_new` and
+ *  `custom_delete` in a trace file (see AllocTrace.hpp), which is started
+ *  by setting the environment variable `RPOOLS_TRACE` to the path of the
+ *  file.
+ *  @par
+ *  Every thread appends its records to a buffer of its own, so recording
+ *  takes no lock. A full buffer is pushed onto a lock-free list and
+ *  a background thread writes the buffers of the list to the file, so the
+ *  threads do not wait for the file either. The buffers are allocated with
+ *  the system allocator, which keeps the recorder out of the pools.
+ *  @par
+ *  The buffer of a thread is written when it is full, when the thread
+ *  exits and, for the thread that stops the recording, when it is stopped.
+ *  The recording is stopped at exit, and the partly filled buffers of the
+ *  threads that are still running then are lost. The allocations that a
+ *  thread makes after its buffer was handed over as it exits are not
+ *  recorded. A forked child does not record, as it has no writer thread.
+ */
+class TraceRecorder {
+public:
+    /** The number of records in the buffer of a thread. */
+    static const size_t BUFFER_RECORDS = 4096;
+
+    /**
+     *  @return true if the allocations are recorded, which is only checked
+     *          against `RPOOLS_TRACE` on the first call.
+     */
+    static bool isRecording() {
+        int state = s_state.load(std::memory_order_relaxed);
+        if (state == UNKNOWN) {
+            state = startFromEnvironment();
+        }
+        return state == RECORDING;
+    }
+
+    /**
+     *  Records an allocation or deallocation of the calling thread.
+     *  @param t_op a `TraceOp`
+     *  @param t_ptr the object
+     *  @param t_size the size of the object or 0 if it is unknown
+     *  @param t_alignment the alignment of the object
+     */
+    static void record(rpools::TraceOp t_op, void* t_ptr, size_t t_size,
+                       size_t t_alignment);
+
+    /**
+     *  Starts recording to the file at `t_path`, unless it is already
+     *  recording.
+     *  @return false if the file cannot be written.
+     */
+    static bool start(const char* t_path);
+
+    /**
+     *  Stops recording after writing the buffer of the calling thread and
+     *  the full buffers of all threads to the file.
+     */
+    static void stop();
+
+private:
+    enum State { UNKNOWN, OFF, STARTING, RECORDING };
+
+    static std::atomic<int> s_state;
+
+    static int startFromEnvironment();
+
+    /**
+     *  Stops recording in a forked child without writing its buffers, which
+     *  are copies of the buffers of the parent.
+     */
+    static void stopInChild();
+};
+
+#endif // __TRACE_RECORDER_H__
@@ -0,0 +1,109 @@
+/**
+ *  @file custom_malloc.cpp
+ *  A replacement for `malloc` and friends which allocates small objects in
+ *  the pools of `custom_new`, so that C code and libraries also use them.
+ *  @par
+ *  This is only part of "libcustommalloc.so", which is built with
+ *  `RPOOLS_MALLOC_INTERPOSITION` so that the memory of the pools themselves
+ *  comes from glibc (see system_alloc.hpp).
+ */
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <malloc.h>
+
+#include "rpools/custom_new/SizeClasses.hpp"
+#include "rpools/custom_new/custom_new_delete.hpp"
+#include "rpools/tools/pool_utils.hpp"
+#include "rpools/tools/system_alloc.hpp"
+
+namespace {
+    using namespace rpools;
+
+    /**
+     *  @return true if `t_alignment` can be given to `posix_memalign`.
+     */
+    bool isValidAlignment(size_t t_alignment) {
+        return t_alignment != 0 && (t_alignment & (t_alignment - 1)) == 0 &&
+            mod(t_alignment, sizeof(void*)) == 0;
+    }
+}
+
+extern "C" {
+
+void* malloc(size_t t_size) noexcept {
+    void* ptr = custom_new_no_throw(t_size);
+    if (!ptr) {
+        errno = ENOMEM;
+    }
+    return ptr;
+}
+
+void free(void* t_ptr) noexcept {
+    custom_delete(t_ptr);
+}
+
+void* calloc(size_t t_num, size_t t_size) noexcept {
+    if (t_size != 0 && t_num > SIZE_MAX / t_size) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    size_t size = t_num * t_size;
+    // big blocks come straight from the system, which zeroes them lazily
+    if (size > MAX_SIZE_CLASS) {
+        return systemCalloc(t_num, t_size);
+    }
+    void* ptr = malloc(size);
+    if (ptr) {
+        std::memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+void* realloc(void* t_ptr, size_t t_size) noexcept {
+    void* ptr = custom_realloc(t_ptr, t_size);
+    if (!ptr && t_size != 0) {
+        errno = ENOMEM;
+    }
+    return ptr;
+}
+
+int posix_memalign(void** t_ptr, size_t t_alignment, size_t t_size) noexcept {
+    if (!isValidAlignment(t_alignment)) {
+        return EINVAL;
+    }
+    void* ptr = custom_new_no_throw(t_size, t_alignment);
+    if (!ptr) {
+        return ENOMEM;
+    }
+    *t_ptr = ptr;
+    return 0;
+}
+
+void* aligned_alloc(size_t t_alignment, size_t t_size) noexcept {
+    if (t_alignment == 0 || (t_alignment & (t_alignment - 1)) != 0) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    // smaller alignments are met by every allocation
+    if (t_alignment < sizeof(void*)) {
+        t_alignment = sizeof(void*);
+    }
+    void* ptr = custom_new_no_throw(t_size, t_alignment);
+    if (!ptr) {
+        errno = ENOMEM;
+    }
+    return ptr;
+}
+
+void* memalign(size_t t_alignment, size_t t_size) noexcept {
+    return aligned_alloc(t_alignment, t_size);
+}
+
+size_t malloc_usable_size(void* t_ptr) noexcept {
+    return custom_usable_size(t_ptr);
+}
+
+}
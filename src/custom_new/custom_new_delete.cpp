@@ -1,57 +1,89 @@
 #include "rpools/custom_new/custom_new_delete.hpp"
 
-#include <cmath>
+#include <cstdlib>
 #include <cstring>
 
 #include "GlobalPools.hpp"
+#include "ReentrancyGuard.hpp"
+#include "TraceRecorder.hpp"
+#include "rpools/tools/PoolMap.hpp"
+#include "rpools/tools/system_alloc.hpp"
 
 namespace {
     using namespace rpools;
 
-    const size_t __threshold = 128; // malloc performs equally well
-                                    // on objects of size > 128
-    const size_t __mod = sizeof(void*) - 1;
-    const size_t __logOfVoid = std::log2(sizeof(void*));
-
-    // Used to mark the first 16 bytes of a malloc-d region
-    struct MallocHeader {
-        char validity[16] = "              \0";
-    };
+    alignas(GlobalPools) char __poolsStorage[sizeof(GlobalPools)];
 
     GlobalPools& getPools() {
-        static GlobalPools pools(__threshold >> __logOfVoid);
-        return pools;
+        // the pools are never destroyed, because memory may still be freed
+        // by static destructors and atexit handlers
+        static GlobalPools* pools = new (__poolsStorage) GlobalPools();
+        return *pools;
     }
-}
 
-void* custom_new_no_throw(size_t t_size, size_t t_alignment) {
-    // use malloc for large sizes
-    if (t_size > __threshold) {
-        // add sizeof(MallocHeader) extra space to denote the fact that the
-        // allocation is malloc-d
-        auto addr = static_cast<char*>(std::malloc(t_size +
-                                                   sizeof(MallocHeader)));
-        auto header = new(addr) MallocHeader();
-        std::strcpy(header->validity, "IsThIsMaLlOcD!\0");
-        // make sure we do not return the extra memory
-        return addr + sizeof(MallocHeader);
-    } else {
-        size_t remainder = t_size & __mod; // t_size % sizeof(void*)
-        // round up to the next multiple of sizeof(void*)
-        t_size = remainder == 0 ? t_size : (t_size + __mod) & ~__mod;
-        // adds 8 in the case when a pool of <t_size> cannot accommodate
-        // an allocation request of alignment <t_alignment>
+    /**
+     *  @return the size of the pool slots in which an object of `t_size`
+     *          bytes and `t_alignment` alignment is allocated or 0 if the
+     *          object is allocated with malloc.
+     */
+    size_t getSlotSize(size_t t_size, size_t t_alignment) {
+        // use malloc for sizes that do not have a pool and for alignments
+        // that the pools do not provide
+        if (t_size > getPools().getMaxSize() ||
+            t_alignment > alignof(max_align_t)) {
+            return 0;
+        }
+        size_t sizeClass = getSizeClass(t_size);
+        // use the next class in the case when the pool of <sizeClass>
+        // cannot accommodate an allocation request of alignment <t_alignment>
         // say t_size is 40 and t_alignment is 16
         // we have defined that pools that are not divisible by
         // 16, have alignment 8, otherwise 16
         // 40 % 16 != 0 -> place the request in a pool that holds
         // objects of size 48 (also note 48 % 16 == 0 -> has an alignment of 16)
-        t_size += (mod(t_size, t_alignment)) == 0 ? 0 : sizeof(void*);
-        void* addr = getPools().getPool(t_size).allocate();
-        return addr;
+        if (mod(getSizeClassSize(sizeClass), t_alignment) != 0) {
+            ++sizeClass;
+        }
+        return getSizeClassSize(sizeClass);
+    }
+
+    /**
+     *  Records an allocation or deallocation if a trace is recorded (see
+     *  `TraceRecorder`), unless it is made by the pools themselves.
+     *  @note Deallocations must be recorded before the memory is freed and
+     *        allocations after it is allocated, so that the records of an
+     *        address that is reused by another thread stay in order.
+     */
+    inline void trace(TraceOp t_op, void* t_ptr, size_t t_size,
+                      size_t t_alignment) {
+        if (TraceRecorder::isRecording() && t_ptr) {
+            ReentrancyGuard guard;
+            if (!guard.isReentrant()) {
+                TraceRecorder::record(t_op, t_ptr, t_size, t_alignment);
+            }
+        }
+    }
+
+    void* allocate(size_t t_size, size_t t_alignment) {
+        ReentrancyGuard guard;
+        size_t slotSize = guard.isReentrant() ?
+            0 : getSlotSize(t_size, t_alignment);
+        if (slotSize != 0) {
+            return getPools().allocate(slotSize);
+        }
+        if (t_alignment > alignof(max_align_t)) {
+            return systemMemalign(t_alignment, t_size);
+        }
+        return systemMalloc(t_size);
     }
 }
 
+void* custom_new_no_throw(size_t t_size, size_t t_alignment) {
+    void* ptr = allocate(t_size, t_alignment);
+    trace(TRACE_ALLOCATE, ptr, t_size, t_alignment);
+    return ptr;
+}
+
 void* custom_new(size_t t_size, size_t t_alignment) {
     void* toRet = custom_new_no_throw(t_size, t_alignment);
     if (toRet == nullptr) {
@@ -61,22 +93,98 @@ void* custom_new(size_t t_size, size_t t_alignment) {
 }
 
 void custom_delete(void* t_ptr) noexcept {
+    trace(TRACE_DEALLOCATE, t_ptr, 0, alignof(max_align_t));
     // find out if the pointer was allocated with malloc
     // or within a pool
-    auto cAddr = reinterpret_cast<char*>(t_ptr);
-    // legal because malloc-d addresses have 16 extra bytes
-    // and pool addressed will always be at least 48 bytes after
-    // the start of some page boundary
-    cAddr -= sizeof(MallocHeader);
-    auto header = reinterpret_cast<MallocHeader*>(cAddr);
-    if (std::strcmp(header->validity, "IsThIsMaLlOcD!\0") == 0) {
-        free(cAddr);
+    if (!PoolMap::contains(t_ptr)) {
+        systemFree(t_ptr);
     } else {
+        ReentrancyGuard guard;
         const PoolHeaderG& ph = GlobalLinkedPool::getPoolHeader(t_ptr);
-        // convert the size to an index of the allocators vector
-        // by dividing it to sizeof(void*)
-        getPools().getPool(ph.sizeOfSlot).deallocate(t_ptr);
+        // the size of the slot identifies the pool (and the thread cache)
+        // in which the pointer is deallocated
+        getPools().deallocate(t_ptr, ph.sizeOfSlot);
+    }
+}
+
+void custom_delete(void* t_ptr, size_t t_size, size_t t_alignment) noexcept {
+    trace(TRACE_DEALLOCATE, t_ptr, t_size, t_alignment);
+    // the size and alignment lead to the pool without reading its header
+    ReentrancyGuard guard;
+    size_t slotSize = getSlotSize(t_size, t_alignment);
+    if (slotSize == 0) {
+        systemFree(t_ptr);
+        return;
+    }
+    // a class whose slots are not aligned at 16 is skipped by objects that
+    // need 16, so the alignment the object was allocated with, which may
+    // differ from `t_alignment`, is known from its pool only
+    if (mod(getSizeClassSize(getSizeClass(t_size)),
+            alignof(max_align_t)) != 0) {
+        slotSize = GlobalLinkedPool::getPoolHeader(t_ptr).sizeOfSlot;
     }
+    getPools().deallocate(t_ptr, slotSize);
+}
+
+void* custom_realloc(void* t_ptr, size_t t_size) noexcept {
+    if (!t_ptr) {
+        return custom_new_no_throw(t_size);
+    }
+    if (t_size == 0) {
+        custom_delete(t_ptr);
+        return nullptr;
+    }
+    size_t oldSlotSize = PoolMap::contains(t_ptr) ?
+        GlobalLinkedPool::getPoolHeader(t_ptr).sizeOfSlot : 0;
+    size_t newSlotSize;
+    {
+        ReentrancyGuard guard;
+        newSlotSize = guard.isReentrant() ?
+            0 : getSlotSize(t_size, alignof(max_align_t));
+    }
+    // the object stays in its slot as long as its size class is the same
+    if (oldSlotSize != 0 && oldSlotSize == newSlotSize) {
+        return t_ptr;
+    }
+    // both sizes are malloc-ed, so the system may grow the block in place
+    if (oldSlotSize == 0 && newSlotSize == 0) {
+        trace(TRACE_DEALLOCATE, t_ptr, 0, alignof(max_align_t));
+        void* newPtr = systemRealloc(t_ptr, t_size);
+        trace(TRACE_ALLOCATE, newPtr ? newPtr : t_ptr, t_size,
+              alignof(max_align_t));
+        return newPtr;
+    }
+    void* newPtr = custom_new_no_throw(t_size);
+    if (newPtr) {
+        size_t oldSize = oldSlotSize != 0 ?
+            oldSlotSize : systemUsableSize(t_ptr);
+        std::memcpy(newPtr, t_ptr, oldSize < t_size ? oldSize : t_size);
+        custom_delete(t_ptr);
+    }
+    return newPtr;
+}
+
+size_t custom_usable_size(void* t_ptr) noexcept {
+    if (!t_ptr) {
+        return 0;
+    }
+    if (PoolMap::contains(t_ptr)) {
+        return GlobalLinkedPool::getPoolHeader(t_ptr).sizeOfSlot;
+    }
+    return systemUsableSize(t_ptr);
+}
+
+void custom_flush_thread_cache() noexcept {
+    ReentrancyGuard guard;
+    getPools().flushThreadCache();
+}
+
+rpools::LockStats custom_lock_stats(size_t t_size) noexcept {
+    ReentrancyGuard guard;
+    if (t_size > getPools().getMaxSize()) {
+        return rpools::LockStats();
+    }
+    return getPools().getPool(t_size).getLockStats();
 }
 
 // list of all new functions:
@@ -87,7 +195,7 @@ void custom_delete(void* t_ptr) noexcept {
 // Some operators are not implemented because their default
 // implementation will not break custom_new/custom_delete
 
-// Note that the C++14/17/20 operators are not included!
+// Note that the C++20 operators are not included!
 
 void* operator new(std::size_t t_size) {
     return custom_new(t_size);
@@ -97,6 +205,15 @@ void* operator new(std::size_t t_size, const std::nothrow_t& nothrow_value) noex
     return custom_new_no_throw(t_size);
 }
 
+void* operator new(std::size_t t_size, std::align_val_t t_alignment) {
+    return custom_new(t_size, static_cast<size_t>(t_alignment));
+}
+
+void* operator new(std::size_t t_size, std::align_val_t t_alignment,
+                   const std::nothrow_t& nothrow_value) noexcept {
+    return custom_new_no_throw(t_size, static_cast<size_t>(t_alignment));
+}
+
 void operator delete(void* t_ptr) noexcept {
     if (t_ptr != nullptr) {
         custom_delete(t_ptr);
@@ -109,6 +226,32 @@ void operator delete(void* t_ptr, const std::nothrow_t& nothrow_value) noexcept
     }
 }
 
+void operator delete(void* t_ptr, std::size_t t_size) noexcept {
+    if (t_ptr != nullptr) {
+        custom_delete(t_ptr, t_size);
+    }
+}
+
+void operator delete(void* t_ptr, std::align_val_t t_alignment) noexcept {
+    if (t_ptr != nullptr) {
+        custom_delete(t_ptr);
+    }
+}
+
+void operator delete(void* t_ptr, std::align_val_t t_alignment,
+                     const std::nothrow_t& nothrow_value) noexcept {
+    if (t_ptr != nullptr) {
+        custom_delete(t_ptr);
+    }
+}
+
+void operator delete(void* t_ptr, std::size_t t_size,
+                     std::align_val_t t_alignment) noexcept {
+    if (t_ptr != nullptr) {
+        custom_delete(t_ptr, t_size, static_cast<size_t>(t_alignment));
+    }
+}
+
 void* operator new[](std::size_t t_size) {
     void* toRet = custom_new(t_size);
     if (toRet == nullptr) {
@@ -121,6 +264,15 @@ void* operator new[](std::size_t t_size, const std::nothrow_t& nothrow_value) no
     return custom_new_no_throw(t_size);
 }
 
+void* operator new[](std::size_t t_size, std::align_val_t t_alignment) {
+    return custom_new(t_size, static_cast<size_t>(t_alignment));
+}
+
+void* operator new[](std::size_t t_size, std::align_val_t t_alignment,
+                     const std::nothrow_t& nothrow_value) noexcept {
+    return custom_new_no_throw(t_size, static_cast<size_t>(t_alignment));
+}
+
 void operator delete[](void* t_ptr) noexcept {
     custom_delete(t_ptr);
 }
@@ -128,3 +280,25 @@ void operator delete[](void* t_ptr) noexcept {
 void operator delete[](void* t_ptr, const std::nothrow_t& nothrow_value) noexcept {
     custom_delete(t_ptr);
 }
+
+void operator delete[](void* t_ptr, std::size_t t_size) noexcept {
+    if (t_ptr != nullptr) {
+        custom_delete(t_ptr, t_size);
+    }
+}
+
+void operator delete[](void* t_ptr, std::align_val_t t_alignment) noexcept {
+    custom_delete(t_ptr);
+}
+
+void operator delete[](void* t_ptr, std::align_val_t t_alignment,
+                       const std::nothrow_t& nothrow_value) noexcept {
+    custom_delete(t_ptr);
+}
+
+void operator delete[](void* t_ptr, std::size_t t_size,
+                       std::align_val_t t_alignment) noexcept {
+    if (t_ptr != nullptr) {
+        custom_delete(t_ptr, t_size, static_cast<size_t>(t_alignment));
+    }
+}
@@ -1,15 +1,43 @@
 #include "rpools/custom_new/custom_new_delete_debug.hpp"
+#include <algorithm> // max
+#include <cstdlib> // aligned_alloc
+#include <new> // bad_alloc
+
 #include "AllocCollector.hpp"
 
 namespace {
     AllocCollector ac;
+
+    /**
+     * Precedes every object, so that its deallocation finds the counter of
+     * its allocation without looking the object up.
+     */
+    struct Header {
+        void* block; // the allocated memory, which holds the object
+        ObjectCounter* counter;
+    };
+
+    Header* getHeader(void* t_ptr) {
+        return static_cast<Header*>(t_ptr) - 1;
+    }
 }
 
 void* custom_new_no_throw(size_t t_size, size_t t_alignment,
                           const char* t_name, size_t t_baseSize,
                           const char* t_funcName) {
-    void* toRet = malloc(t_size);
-    ac.addObject(t_size, t_alignment, t_name, t_baseSize, t_funcName, toRet);
+    // the header fills the space before the object that keeps it aligned
+    size_t offset = std::max(t_alignment, alignof(max_align_t));
+    void* block = offset > alignof(max_align_t) ?
+        aligned_alloc(offset, (t_size + offset * 2 - 1) / offset * offset) :
+        malloc(t_size + offset);
+    if (block == nullptr) {
+        return nullptr;
+    }
+    void* toRet = static_cast<char*>(block) + offset;
+    Header* header = getHeader(toRet);
+    header->block = block;
+    header->counter = ac.addObject(t_size, t_alignment, t_name, t_baseSize,
+                                   t_funcName);
     return toRet;
 }
 
@@ -25,6 +53,10 @@ void* custom_new(size_t t_size, size_t t_alignment,
 }
 
 void custom_delete(void* t_ptr) noexcept {
-    ac.removeObject(t_ptr);
-    free(t_ptr);
+    if (t_ptr == nullptr) {
+        return;
+    }
+    Header* header = getHeader(t_ptr);
+    ac.removeObject(header->counter);
+    free(header->block);
 }
@@ -1,35 +1,174 @@
 #include "rpools/tools/LMLock.hpp"
-#include <utility>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 using namespace rpools;
 
+const uint32_t LMLock::SPIN_ROUNDS;
+const uint32_t LMLock::MAX_BACKOFF;
+
+namespace {
+    const uint32_t FREE = 0;
+    const uint32_t LOCKED = 1;
+    const uint32_t SLEEPERS = 2;
+
+    /**
+     *  Tells the CPU that the thread is spinning.
+     */
+    inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        __asm__ __volatile__("yield" ::: "memory");
+#endif
+    }
+
+    /**
+     *  Sleeps until `t_state` is woken up, unless it does not hold
+     *  `t_expected` anymore.
+     */
+    void futexWait(std::atomic<uint32_t>& t_state, uint32_t t_expected) {
+#ifdef __linux__
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&t_state),
+                FUTEX_WAIT_PRIVATE, t_expected, nullptr, nullptr, 0);
+#else
+        (void)t_state;
+        (void)t_expected;
+        std::this_thread::yield();
+#endif
+    }
+
+    /**
+     *  Wakes up one of the threads sleeping on `t_state`.
+     */
+    void futexWake(std::atomic<uint32_t>& t_state) {
+#ifdef __linux__
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&t_state),
+                FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+        (void)t_state;
+#endif
+    }
+
+#ifdef RPOOLS_LOCK_STATS
+    /**
+     *  Adds to a counter which is only written by the holder of the lock.
+     */
+    inline void add(std::atomic<uint64_t>& t_counter, uint64_t t_value) {
+        t_counter.store(t_counter.load(std::memory_order_relaxed) + t_value,
+                        std::memory_order_relaxed);
+    }
+#endif
+}
+
 LMLock::LMLock()
-    : m_lock(
-#ifdef __x86_64
-             LIGHT_LOCK_INIT
+    : m_state(FREE)
+#ifdef RPOOLS_LOCK_STATS
+      , m_acquisitions(0),
+      m_contentions(0),
+      m_waitNanos(0)
 #endif
-      ) { }
+      { }
 
 LMLock::LMLock(LMLock&& other)
-    : m_lock(std::move(other.m_lock)) { }
+    : m_state(other.m_state.load())
+#ifdef RPOOLS_LOCK_STATS
+      , m_acquisitions(other.m_acquisitions.load()),
+      m_contentions(other.m_contentions.load()),
+      m_waitNanos(other.m_waitNanos.load())
+#endif
+      { }
 
 LMLock& LMLock::operator =(LMLock&& other) {
-    m_lock = std::move(other.m_lock);
+    m_state = other.m_state.load();
+#ifdef RPOOLS_LOCK_STATS
+    m_acquisitions = other.m_acquisitions.load();
+    m_contentions = other.m_contentions.load();
+    m_waitNanos = other.m_waitNanos.load();
+#endif
     return *this;
 }
 
 void LMLock::lock() {
-#ifdef __x86_64
-    light_lock(&m_lock);
+    uint32_t expected = FREE;
+    if (m_state.compare_exchange_strong(expected, LOCKED,
+                                        std::memory_order_acquire,
+                                        std::memory_order_relaxed)) {
+#ifdef RPOOLS_LOCK_STATS
+        add(m_acquisitions, 1);
+#endif
+        return;
+    }
+#ifdef RPOOLS_LOCK_STATS
+    auto start = std::chrono::steady_clock::now();
+    lockSlow();
+    auto waited = std::chrono::steady_clock::now() - start;
+    add(m_acquisitions, 1);
+    add(m_contentions, 1);
+    add(m_waitNanos, std::chrono::duration_cast<std::chrono::nanoseconds>(
+            waited).count());
 #else
-    m_lock.lock();
+    lockSlow();
 #endif
 }
 
+bool LMLock::try_lock() {
+    uint32_t expected = FREE;
+    // sequentially consistent, so that the state is not read before the
+    // caller's earlier stores are visible (see the note in LMLock.hpp)
+    if (!m_state.compare_exchange_strong(expected, LOCKED,
+                                         std::memory_order_seq_cst)) {
+        return false;
+    }
+#ifdef RPOOLS_LOCK_STATS
+    add(m_acquisitions, 1);
+#endif
+    return true;
+}
+
 void LMLock::unlock() {
-#ifdef __x86_64
-    light_unlock(&m_lock);
-#else
-    m_lock.unlock();
+    if (m_state.exchange(FREE, std::memory_order_release) == SLEEPERS) {
+        futexWake(m_state);
+    }
+}
+
+LockStats LMLock::getStats() const {
+    LockStats stats;
+#ifdef RPOOLS_LOCK_STATS
+    stats.acquisitions = m_acquisitions.load(std::memory_order_relaxed);
+    stats.contentions = m_contentions.load(std::memory_order_relaxed);
+    stats.waitNanos = m_waitNanos.load(std::memory_order_relaxed);
 #endif
+    return stats;
+}
+
+void LMLock::lockSlow() {
+    // spin while the holder is likely to release the lock soon, backing off
+    // exponentially so that the waiters do not hammer its cache line
+    uint32_t backoff = 1;
+    for (uint32_t i = 0; i < SPIN_ROUNDS; ++i) {
+        for (uint32_t j = 0; j < backoff; ++j) {
+            cpuRelax();
+        }
+        backoff = std::min(backoff * 2, MAX_BACKOFF);
+        uint32_t expected = FREE;
+        if (m_state.load(std::memory_order_relaxed) == FREE &&
+            m_state.compare_exchange_weak(expected, LOCKED,
+                                          std::memory_order_acquire,
+                                          std::memory_order_relaxed)) {
+            return;
+        }
+    }
+    // sleep until the lock is released, the lock is taken in the SLEEPERS
+    // state as other threads may still be sleeping on it
+    while (m_state.exchange(SLEEPERS, std::memory_order_acquire) != FREE) {
+        futexWait(m_state, SLEEPERS);
+    }
 }
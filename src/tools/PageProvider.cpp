@@ -0,0 +1,249 @@
+#include "rpools/tools/PageProvider.hpp"
+
+#include <cstdlib>
+#include <new>
+
+#include "rpools/tools/PoolMap.hpp"
+#include "rpools/tools/pool_utils.hpp"
+#include "rpools/tools/system_alloc.hpp"
+
+#ifdef RPOOLS_MMAP_ARENAS
+#include <sys/mman.h>
+
+#include "rpools/allocators/Node.hpp"
+#include "rpools/tools/LMLock.hpp"
+
+#ifdef RPOOLS_NUMA
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "rpools/tools/Numa.hpp"
+#endif
+
+namespace {
+    using namespace rpools;
+
+    /** The number of bytes that are reserved by an arena. */
+    const size_t __arenaSize = 64 << 20;
+    /** The size of a transparent huge page. */
+    const size_t __hugePageSize = 2 << 20;
+#ifdef RPOOLS_NUMA
+    /** The number of NUMA nodes that get arenas of their own. */
+    const unsigned int __numOfArenas = 64;
+
+    /** The number of NUMA nodes in the node masks of the kernel. */
+    const unsigned int __maxNodes = 1024;
+    const unsigned int __bitsPerLong = sizeof(unsigned long) * 8;
+
+    /**
+     *  Makes the physical pages of a region come from NUMA node `t_node`,
+     *  or from another node if it runs out of memory.
+     */
+    void bindToNode(void* t_region, size_t t_size, unsigned int t_node) {
+        if (t_node >= __maxNodes) {
+            return;
+        }
+        unsigned long mask[__maxNodes / __bitsPerLong] = {};
+        mask[t_node / __bitsPerLong] = 1UL << (t_node % __bitsPerLong);
+        syscall(SYS_mbind, t_region, t_size, MPOL_PREFERRED, mask,
+                __maxNodes, 0);
+    }
+
+    /**
+     *  @return the node that the pool at `t_pool` was bound to by
+     *          `bindToNode`, or 0 if it was not bound.
+     */
+    unsigned int getBoundNode(void* t_pool) {
+        int mode;
+        unsigned long mask[__maxNodes / __bitsPerLong] = {};
+        if (syscall(SYS_get_mempolicy, &mode, mask, __maxNodes, t_pool,
+                    MPOL_F_ADDR) != 0) {
+            return 0;
+        }
+        for (unsigned int i = 0; i < __maxNodes / __bitsPerLong; ++i) {
+            if (mask[i] != 0) {
+                return i * __bitsPerLong + __builtin_ctzl(mask[i]);
+            }
+        }
+        return 0;
+    }
+#else
+    const unsigned int __numOfArenas = 1;
+#endif
+
+    /**
+     *  Hands out pools from virtual regions that are reserved with `mmap`.
+     *  Pools that are given back are kept in a free list and their physical
+     *  memory is returned to the system.
+     */
+    class Arena {
+    public:
+        /**
+         *  @param t_node the NUMA node that new regions are bound to
+         */
+        void* allocate(unsigned int t_node) {
+            m_lock.lock();
+            void* pool = m_freePools.next;
+            if (pool) {
+                m_freePools.next = m_freePools.next->next;
+            } else {
+                if (m_current == m_end && !reserve(t_node)) {
+                    m_lock.unlock();
+                    return nullptr;
+                }
+                pool = m_current;
+                m_current += getPoolSpan();
+            }
+            m_lock.unlock();
+            return pool;
+        }
+
+        void lock() { m_lock.lock(); }
+        void unlock() { m_lock.unlock(); }
+
+        void deallocate(void* t_pool) {
+#ifdef MADV_FREE
+            madvise(t_pool, getPoolSpan(), MADV_FREE);
+#else
+            madvise(t_pool, getPoolSpan(), MADV_DONTNEED);
+#endif
+            m_lock.lock();
+            auto node = new (t_pool) Node(m_freePools.next);
+            m_freePools.next = node;
+            m_lock.unlock();
+        }
+
+    private:
+        LMLock m_lock;
+        Node m_freePools;
+        char* m_current = nullptr;
+        char* m_end = nullptr;
+
+        /**
+         *  Reserves a new region of memory from which pools are carved.
+         *  @return true if the region was reserved.
+         */
+        bool reserve(unsigned int t_node) {
+            size_t alignment = getPoolSpan();
+#ifdef RPOOLS_HUGEPAGES
+            if (alignment < __hugePageSize) {
+                alignment = __hugePageSize;
+            }
+#endif
+            size_t size = __arenaSize < alignment ? alignment : __arenaSize;
+            // reserve extra space so that the arena can be aligned
+            size_t mapped = size + alignment;
+            void* region = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                                -1, 0);
+            if (region == MAP_FAILED) {
+                return false;
+            }
+            auto start = reinterpret_cast<size_t>(region);
+            auto aligned = (start + alignment - 1) & ~(alignment - 1);
+            // give back the unaligned head and the tail of the region
+            if (aligned != start) {
+                munmap(region, aligned - start);
+            }
+            size_t tail = mapped - (aligned - start) - size;
+            if (tail != 0) {
+                munmap(reinterpret_cast<void*>(aligned + size), tail);
+            }
+            m_current = reinterpret_cast<char*>(aligned);
+            m_end = m_current + size;
+#ifdef RPOOLS_HUGEPAGES
+            madvise(m_current, size, MADV_HUGEPAGE);
+#endif
+#ifdef RPOOLS_NUMA
+            bindToNode(m_current, size, t_node);
+#else
+            (void)t_node;
+#endif
+            return true;
+        }
+    };
+
+    Arena& getArena(unsigned int t_node) {
+        static Arena arenas[__numOfArenas];
+        return arenas[t_node % __numOfArenas];
+    }
+
+    void* allocateSpan(unsigned int t_node) {
+        return getArena(t_node).allocate(t_node);
+    }
+
+    void lockArenas() {
+        for (unsigned int i = 0; i < __numOfArenas; ++i) {
+            getArena(i).lock();
+        }
+    }
+
+    void unlockArenas() {
+        for (unsigned int i = 0; i < __numOfArenas; ++i) {
+            getArena(i).unlock();
+        }
+    }
+
+    void deallocateSpan(void* t_pool) {
+#ifdef RPOOLS_NUMA
+        // the pool goes back to the arena of the node it is bound to
+        getArena(getBoundNode(t_pool)).deallocate(t_pool);
+#else
+        getArena(0).deallocate(t_pool);
+#endif
+    }
+}
+
+#else
+
+namespace {
+    using namespace rpools;
+
+    void* allocateSpan(unsigned int) {
+        size_t poolSpan = getPoolSpan();
+        return systemMemalign(poolSpan, poolSpan);
+    }
+
+    void deallocateSpan(void* t_pool) {
+        systemFree(t_pool);
+    }
+
+    void lockArenas() {}
+
+    void unlockArenas() {}
+}
+
+#endif
+
+void* rpools::allocatePool() {
+#ifdef RPOOLS_NUMA
+    return allocatePool(getNumaNode());
+#else
+    return allocatePool(0);
+#endif
+}
+
+void* rpools::allocatePool(unsigned int t_node) {
+    void* pool = allocateSpan(t_node);
+    // register the pool so that its slots can be told apart from malloc-ed
+    // memory (see PoolMap)
+    if (pool && !PoolMap::insert(pool)) {
+        deallocateSpan(pool);
+        return nullptr;
+    }
+    return pool;
+}
+
+void rpools::deallocatePool(void* t_pool) {
+    PoolMap::erase(t_pool);
+    deallocateSpan(t_pool);
+}
+
+void rpools::lockArenasForFork() {
+    lockArenas();
+}
+
+void rpools::unlockArenasAfterFork() {
+    unlockArenas();
+}
@@ -0,0 +1,61 @@
+#include "rpools/tools/PoolMap.hpp"
+
+#include <cassert>
+#include <sys/mman.h>
+
+using namespace rpools;
+
+const size_t PoolMap::ADDRESS_BITS;
+const size_t PoolMap::LEAF_BITS;
+const size_t PoolMap::ROOT_SIZE;
+const size_t PoolMap::LEAF_MASK;
+
+std::atomic<PoolMap::Leaf*> PoolMap::s_root[PoolMap::ROOT_SIZE];
+
+bool PoolMap::insert(const void* t_pool) {
+    size_t number = reinterpret_cast<size_t>(t_pool) >> getShift();
+    Leaf* leaf = getLeaf(number);
+    if (!leaf) {
+        return false;
+    }
+    size_t bit = number & LEAF_MASK;
+    leaf->words[bit >> 6].fetch_or(uint64_t(1) << (bit & 63),
+                                   std::memory_order_relaxed);
+    return true;
+}
+
+void PoolMap::erase(const void* t_pool) {
+    size_t number = reinterpret_cast<size_t>(t_pool) >> getShift();
+    // a pool beyond the map cannot have been inserted
+    assert((number >> LEAF_BITS) < ROOT_SIZE);
+    Leaf* leaf = s_root[number >> LEAF_BITS].load(std::memory_order_acquire);
+    size_t bit = number & LEAF_MASK;
+    leaf->words[bit >> 6].fetch_and(~(uint64_t(1) << (bit & 63)),
+                                    std::memory_order_relaxed);
+}
+
+PoolMap::Leaf* PoolMap::getLeaf(size_t t_number) {
+    size_t root = t_number >> LEAF_BITS;
+    if (root >= ROOT_SIZE) {
+        return nullptr;
+    }
+    Leaf* leaf = s_root[root].load(std::memory_order_acquire);
+    if (leaf) {
+        return leaf;
+    }
+    // leaves are mapped directly so that the map never calls malloc,
+    // the zeroed pages are a leaf without any pools
+    void* region = mmap(nullptr, sizeof(Leaf), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        return nullptr;
+    }
+    auto newLeaf = static_cast<Leaf*>(region);
+    // another thread may have created the leaf in the meantime
+    if (!s_root[root].compare_exchange_strong(leaf, newLeaf,
+                                              std::memory_order_acq_rel)) {
+        munmap(region, sizeof(Leaf));
+        return leaf;
+    }
+    return newLeaf;
+}
@@ -0,0 +1,103 @@
+#include "catch.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "nlohmann/json.hpp"
+#include "AllocCollector.hpp"
+using std::vector;
+
+namespace {
+    const char* NAME = "TestObject";
+    const char* FUNCTION = "allocate()";
+
+    /**
+     * Destroys the collector and reads the last snapshot that it wrote.
+     */
+    nlohmann::json takeLastSnapshot(std::unique_ptr<AllocCollector>& t_ac) {
+        t_ac.reset();
+        std::string path = "object_snapshots_" + std::to_string(getpid()) +
+            ".json";
+        std::ifstream file(path);
+        nlohmann::json snapshots;
+        file >> snapshots;
+        std::remove(path.c_str());
+        return snapshots.back();
+    }
+}
+
+TEST_CASE("Snapshots add up the counters of all the threads",
+          "[AllocCollector]") {
+    auto ac = std::unique_ptr<AllocCollector>(new AllocCollector());
+    const size_t numOfThreads = 4;
+    const size_t numOfObjects = 1000;
+    vector<vector<ObjectCounter*>> counters(numOfThreads);
+    vector<std::thread> threads;
+    for (size_t t = 0; t < numOfThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (size_t i = 0; i < numOfObjects; ++i) {
+                counters[t].push_back(ac->addObject(16, 8, NAME, 8,
+                                                    FUNCTION));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+    // every thread frees half of the objects of the next thread
+    for (size_t t = 0; t < numOfThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            auto& objects = counters[(t + 1) % numOfThreads];
+            for (size_t i = 0; i < numOfObjects / 2; ++i) {
+                ac->removeObject(objects[i]);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    auto entry = takeLastSnapshot(ac)[NAME]["8"]["16"];
+    REQUIRE(entry["current"] == numOfThreads * numOfObjects / 2);
+    REQUIRE(entry["array"] == 2);
+    REQUIRE(entry["base_size"] == 8);
+    REQUIRE(entry["function"] == FUNCTION);
+}
+
+TEST_CASE("The shard of an exited thread is reused", "[AllocCollector]") {
+    auto ac = std::unique_ptr<AllocCollector>(new AllocCollector());
+    // allocates from a destructor that runs after the collector's one,
+    // whose keys are destroyed in the order they were created
+    static AllocCollector* collector;
+    static ObjectCounter* late;
+    collector = ac.get();
+    pthread_key_t lateKey;
+    int created = -1;
+    ObjectCounter* first = nullptr;
+    std::thread([&]() {
+        first = ac->addObject(32, 16, NAME, 32, FUNCTION);
+        created = pthread_key_create(&lateKey, [](void*) {
+            late = collector->addObject(32, 16, NAME, 32, FUNCTION);
+        });
+        pthread_setspecific(lateKey, collector);
+    }).join();
+    REQUIRE(created == 0);
+    ObjectCounter* second = nullptr;
+    std::thread([&]() {
+        second = ac->addObject(32, 16, NAME, 32, FUNCTION);
+    }).join();
+    pthread_key_delete(lateKey);
+    // the second thread got the counters of the first one, which did not
+    // count in them after it handed them over
+    REQUIRE(first == second);
+    REQUIRE(late != nullptr);
+    REQUIRE(late != first);
+    auto entry = takeLastSnapshot(ac)[NAME]["16"]["32"];
+    REQUIRE(entry["current"] == 3);
+}
@@ -0,0 +1,146 @@
+#include "catch.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <malloc.h>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+using std::vector;
+
+#include "rpools/allocators/GlobalLinkedPool.hpp"
+#include "rpools/custom_new/SizeClasses.hpp"
+#include "rpools/tools/PoolMap.hpp"
+using namespace rpools;
+
+TEST_CASE("Small mallocs are allocated in pools", "[custom_malloc]") {
+    void* small = malloc(40);
+    void* large = malloc(MAX_SIZE_CLASS + 1);
+    REQUIRE(PoolMap::contains(small));
+    REQUIRE_FALSE(PoolMap::contains(large));
+    REQUIRE((size_t)small % 16 == 0);
+    REQUIRE(malloc_usable_size(small) >= 40);
+    REQUIRE(malloc_usable_size(large) >= MAX_SIZE_CLASS + 1);
+    free(small);
+    free(large);
+    free(nullptr);
+}
+
+TEST_CASE("C library functions allocate in pools", "[custom_malloc]") {
+    char* copy = strdup("a string which is copied");
+    REQUIRE(PoolMap::contains(copy));
+    REQUIRE(std::strcmp(copy, "a string which is copied") == 0);
+    free(copy);
+}
+
+TEST_CASE("calloc zeroes reused slots", "[custom_malloc]") {
+    auto bytes = static_cast<char*>(malloc(64));
+    std::memset(bytes, 0xff, 64);
+    free(bytes);
+    auto zeroes = static_cast<char*>(calloc(8, 8));
+    for (size_t i = 0; i < 64; ++i) {
+        REQUIRE(zeroes[i] == 0);
+    }
+    free(zeroes);
+    // the overflow is only detected at run time
+    volatile size_t huge = SIZE_MAX / 2;
+    REQUIRE(calloc(huge, 4) == nullptr);
+}
+
+TEST_CASE("realloc keeps the contents when objects move", "[custom_malloc]") {
+    auto bytes = static_cast<unsigned char*>(malloc(24));
+    for (size_t i = 0; i < 24; ++i) {
+        bytes[i] = i;
+    }
+    for (size_t size = 32; size <= 4 * MAX_SIZE_CLASS; size *= 2) {
+        bytes = static_cast<unsigned char*>(realloc(bytes, size));
+        REQUIRE(bytes != nullptr);
+        for (size_t i = 0; i < 24; ++i) {
+            REQUIRE(bytes[i] == i);
+        }
+    }
+    bytes = static_cast<unsigned char*>(realloc(bytes, 16));
+    REQUIRE(bytes[15] == 15);
+    REQUIRE(realloc(bytes, 0) == nullptr);
+}
+
+TEST_CASE("Aligned allocations are correctly aligned", "[custom_malloc]") {
+    for (size_t alignment = 8; alignment <= 4096; alignment <<= 1) {
+        void* ptr = nullptr;
+        REQUIRE(posix_memalign(&ptr, alignment, 24) == 0);
+        REQUIRE((size_t)ptr % alignment == 0);
+        free(ptr);
+        ptr = aligned_alloc(alignment, alignment);
+        REQUIRE((size_t)ptr % alignment == 0);
+        free(ptr);
+    }
+    void* ptr = nullptr;
+    REQUIRE(posix_memalign(&ptr, 24, 24) == EINVAL);
+}
+
+TEST_CASE("Threads can malloc and free concurrently", "[custom_malloc]") {
+    vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([]() {
+            vector<void*> ptrs(10000);
+            for (size_t i = 0; i < ptrs.size(); ++i) {
+                ptrs[i] = malloc(i % 256);
+            }
+            for (size_t i = 0; i < ptrs.size(); ++i) {
+                free(ptrs[i]);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+TEST_CASE("Forked children can malloc while other threads do",
+          "[custom_malloc]") {
+    std::atomic<bool> stopping(false);
+    vector<std::thread> threads;
+    for (int t = 0; t < 3; ++t) {
+        threads.emplace_back([&]() {
+            // more objects than a thread caches, so that the threads keep
+            // taking the lock of the pool
+            vector<void*> ptrs(1024);
+            while (!stopping.load(std::memory_order_relaxed)) {
+                for (auto& ptr : ptrs) {
+                    ptr = malloc(48);
+                }
+                for (auto ptr : ptrs) {
+                    free(ptr);
+                }
+            }
+        });
+    }
+    int failed = 0;
+    for (int i = 0; i < 200; ++i) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            // a child that waits on a lock of the parent's threads is killed
+            alarm(2);
+            vector<void*> ptrs(4096);
+            for (auto& ptr : ptrs) {
+                ptr = malloc(48);
+            }
+            for (auto ptr : ptrs) {
+                free(ptr);
+            }
+            _exit(0);
+        }
+        int status = -1;
+        if (pid < 0 || waitpid(pid, &status, 0) != pid ||
+            !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            ++failed;
+        }
+    }
+    stopping.store(true);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(failed == 0);
+}
@@ -1,11 +1,21 @@
 #include "catch.hpp"
 
+#include <cstdio>
+#include <cstdlib>
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include <vector>
 using std::vector;
 
 #include "rpools/custom_new/custom_new_delete.hpp"
+#include "rpools/custom_new/SizeClasses.hpp"
 #include "rpools/allocators/NSGlobalLinkedPool.hpp"
+#include "rpools/tools/PoolMap.hpp"
+#include "CpuCaches.hpp"
+#include "TraceRecorder.hpp"
 using rpools::NSGlobalLinkedPool;
+using rpools::GlobalLinkedPool;
 
 TEST_CASE("Allocations between 0 and 128 bytes have correct alignment",
           "[custom_new_delete]") {
@@ -21,20 +31,30 @@ TEST_CASE("Pointers to objects of size < 129 are deallocated using GlobalLinkedP
     for (size_t i = 0; i <= 128; ++i) {
         allocs[i] = custom_new_no_throw(i, sizeof(void*));
     }
-    size_t index = allocs.size() - 1;
+    // slots that are cached by this thread count as occupied
+    custom_flush_thread_cache();
     for (size_t i = allocs.size(); i > 0; --i) {
         // we do not want to deal with dangling references
         // because our pool header will get destroyed once we
-        // deallocate the last object of the pool
-        if ((i - 1) % 8 == 1) {
+        // deallocate the last object of the pool, so we look at
+        // an object that is still allocated in the same pool
+        void* neighbour = nullptr;
+        for (size_t j = 0; j < i - 1; ++j) {
+            if (((size_t)allocs[j] & rpools::getPoolMask()) ==
+                ((size_t)allocs[i-1] & rpools::getPoolMask())) {
+                neighbour = allocs[j];
+            }
+        }
+        if (!neighbour) {
             custom_delete(allocs[i-1]);
-            index = i - 2;
+            custom_flush_thread_cache();
         } else {
             size_t oldSize =
                 NSGlobalLinkedPool::getPoolHeader(allocs[i-1]).occupiedSlots;
             custom_delete(allocs[i-1]);
+            custom_flush_thread_cache();
             REQUIRE(oldSize - 1 ==
-                    NSGlobalLinkedPool::getPoolHeader(allocs[index]).occupiedSlots);
+                    NSGlobalLinkedPool::getPoolHeader(neighbour).occupiedSlots);
         }
     }
 }
@@ -51,3 +71,280 @@ TEST_CASE("121 aligned at 16 bytes will get allocated into a pool of size 128",
     REQUIRE((size_t)res % 16 == 0);
     REQUIRE(NSGlobalLinkedPool::getPoolHeader(res).sizeOfSlot == 128);
 }
+
+TEST_CASE("Deallocated objects are reused by the same thread",
+          "[custom_new_delete]") {
+    void* first = custom_new(24);
+    custom_delete(first);
+    REQUIRE(custom_new(24) == first);
+    custom_delete(first);
+    custom_flush_thread_cache();
+}
+
+TEST_CASE("Size classes are spaced at 25% at most above 128 bytes",
+          "[SizeClasses]") {
+    using namespace rpools;
+    static_assert(getSizeClassSize(computeSizeClass(129)) == 160,
+                  "129 bytes belong to the class of 160 bytes");
+    for (size_t i = 1; i < NUM_SIZE_CLASSES; ++i) {
+        size_t prev = getSizeClassSize(i - 1);
+        size_t size = getSizeClassSize(i);
+        REQUIRE(size > prev);
+        REQUIRE((prev < 128 || (size - prev) * 4 <= prev));
+        REQUIRE((size < 64 || size % 16 == 0));
+    }
+    for (size_t size = 0; size <= MAX_SIZE_CLASS; ++size) {
+        size_t sizeClass = getSizeClass(size);
+        REQUIRE(sizeClass == computeSizeClass(size));
+        REQUIRE(getSizeClassSize(sizeClass) >= size);
+        REQUIRE((sizeClass == 0 || getSizeClassSize(sizeClass - 1) < size));
+    }
+}
+
+TEST_CASE("Mid-sized objects are allocated in the pool of their class",
+          "[custom_new_delete]") {
+    using rpools::getSizeClass;
+    using rpools::getSizeClassSize;
+    for (size_t size : {129, 500}) {
+        void* ptr = custom_new(size);
+        REQUIRE((size_t)ptr % 16 == 0);
+        // bigger objects are malloc-ed when RPOOLS_MAX_SIZE_CLASS is small
+        if (size <= rpools::MAX_SIZE_CLASS) {
+            REQUIRE(NSGlobalLinkedPool::getPoolHeader(ptr).sizeOfSlot ==
+                    getSizeClassSize(getSizeClass(size)));
+        }
+        custom_delete(ptr);
+    }
+    custom_flush_thread_cache();
+}
+
+TEST_CASE("Large objects are malloc-ed and told apart by the pool map",
+          "[custom_new_delete]") {
+    void* large = custom_new(rpools::MAX_SIZE_CLASS + 1);
+    void* small = custom_new(32);
+    REQUIRE((size_t)large % 16 == 0);
+    REQUIRE_FALSE(rpools::PoolMap::contains(large));
+    REQUIRE(rpools::PoolMap::contains(small));
+    custom_delete(large);
+    custom_delete(small);
+    custom_flush_thread_cache();
+}
+
+TEST_CASE("Sized delete returns the slot to the pool of its class",
+          "[custom_new_delete]") {
+    void* first = custom_new(100);
+    custom_delete(first, 100);
+    REQUIRE(custom_new(100) == first);
+    custom_delete(first, 100);
+    void* large = custom_new(rpools::MAX_SIZE_CLASS + 1);
+    custom_delete(large, rpools::MAX_SIZE_CLASS + 1);
+    custom_flush_thread_cache();
+}
+
+TEST_CASE("Sized delete finds the slot whatever the alignment up to 16",
+          "[custom_new_delete]") {
+    // 40 bytes are allocated in slots of 40 at 8 and of 48 at 16
+    for (size_t alignment : {8, 16}) {
+        void* ptr = custom_new(40, alignment);
+        size_t usable = custom_usable_size(ptr);
+        custom_delete(ptr, 40, 24 - alignment);
+        void* again = custom_new(40, alignment);
+        REQUIRE(again == ptr);
+        REQUIRE(custom_usable_size(again) == usable);
+        custom_delete(again, 40);
+    }
+    custom_flush_thread_cache();
+}
+
+TEST_CASE("Lock statistics are read for the pool of a size class",
+          "[custom_new_delete]") {
+    custom_delete(custom_new(100));
+    // the thread cache only takes the pool lock when it is flushed
+    custom_flush_thread_cache();
+#ifdef RPOOLS_LOCK_STATS
+    REQUIRE(custom_lock_stats(100).acquisitions > 0);
+#else
+    REQUIRE(custom_lock_stats(100).acquisitions == 0);
+#endif
+    REQUIRE(custom_lock_stats(rpools::MAX_SIZE_CLASS + 1).acquisitions == 0);
+}
+
+TEST_CASE("Over-aligned objects are correctly aligned",
+          "[custom_new_delete]") {
+    for (size_t alignment = 32; alignment <= 4096; alignment <<= 1) {
+        void* ptr = custom_new(24, alignment);
+        REQUIRE((size_t)ptr % alignment == 0);
+        custom_delete(ptr, 24, alignment);
+    }
+    struct alignas(64) Vector { float values[16]; };
+    Vector* vectors = new Vector[3];
+    REQUIRE((size_t)vectors % 64 == 0);
+    delete[] vectors;
+}
+
+TEST_CASE("Objects are only moved by realloc if their class changes",
+          "[custom_new_delete]") {
+    auto bytes = static_cast<unsigned char*>(custom_new(100));
+    REQUIRE(custom_usable_size(bytes) == 112);
+    for (size_t i = 0; i < 100; ++i) {
+        bytes[i] = i;
+    }
+    REQUIRE(custom_realloc(bytes, 112) == bytes);
+    REQUIRE(custom_realloc(bytes, 97) == bytes);
+    auto moved = static_cast<unsigned char*>(custom_realloc(bytes, 113));
+    REQUIRE(moved != bytes);
+    REQUIRE(custom_usable_size(moved) == 128);
+    // crossing the size above which objects are malloc-ed
+    size_t large = rpools::MAX_SIZE_CLASS * 2;
+    moved = static_cast<unsigned char*>(custom_realloc(moved, large));
+    REQUIRE_FALSE(rpools::PoolMap::contains(moved));
+    REQUIRE(custom_usable_size(moved) >= large);
+    moved = static_cast<unsigned char*>(custom_realloc(moved, 100));
+    REQUIRE(rpools::PoolMap::contains(moved));
+    for (size_t i = 0; i < 100; ++i) {
+        REQUIRE(moved[i] == i);
+    }
+    REQUIRE(custom_realloc(moved, 0) == nullptr);
+    REQUIRE(custom_usable_size(nullptr) == 0);
+    custom_flush_thread_cache();
+}
+
+TEST_CASE("Forked children do not record the trace of their parent",
+          "[custom_new_delete]") {
+    char path[] = "/tmp/rpools_trace_XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE(fd >= 0);
+    close(fd);
+    REQUIRE(TraceRecorder::start(path));
+    pid_t pid = fork();
+    if (pid == 0) {
+        // the child has no writer thread, so it must not record
+        bool recording = TraceRecorder::isRecording();
+        for (size_t i = 0; i < TraceRecorder::BUFFER_RECORDS * 2; ++i) {
+            custom_delete(custom_new(64));
+        }
+        _exit(recording ? 1 : 0);
+    }
+    REQUIRE(pid > 0);
+    int status;
+    REQUIRE(waitpid(pid, &status, 0) == pid);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+    REQUIRE(TraceRecorder::isRecording());
+    TraceRecorder::stop();
+    custom_flush_thread_cache();
+    unlink(path);
+}
+
+TEST_CASE("CPU caches hand back the slots that were cached last",
+          "[custom_new_delete]") {
+    CpuCaches caches(2);
+    if (!caches.isEnabled()) {
+        // GlobalPools locks the pools directly
+        WARN("rseq is not available, the CPU caches are not tested");
+        return;
+    }
+    // the slots are cached by the CPU, so the thread must not migrate
+    cpu_set_t allowed;
+    REQUIRE(sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+    cpu_set_t current;
+    CPU_ZERO(&current);
+    CPU_SET(sched_getcpu(), &current);
+    REQUIRE(sched_setaffinity(0, sizeof(current), &current) == 0);
+    GlobalLinkedPool pool(64);
+    vector<void*> ptrs;
+    for (size_t i = 0; i < CpuCaches::CAPACITY * 2; ++i) {
+        ptrs.push_back(caches.allocate(1, pool));
+        REQUIRE(ptrs.back() != nullptr);
+    }
+    void* last = ptrs.back();
+    caches.deallocate(1, pool, last);
+    REQUIRE(caches.allocate(1, pool) == last);
+    for (auto ptr : ptrs) {
+        caches.deallocate(1, pool, ptr);
+    }
+    caches.flush(1, pool);
+    REQUIRE(pool.getNumberOfPools() == 0);
+    sched_setaffinity(0, sizeof(allowed), &allowed);
+}
+
+TEST_CASE("CPU caches are flushed on every CPU", "[custom_new_delete]") {
+    CpuCaches caches(2);
+    if (!caches.isEnabled()) {
+        WARN("rseq is not available, the CPU caches are not tested");
+        return;
+    }
+    cpu_set_t allowed;
+    REQUIRE(sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+    GlobalLinkedPool pool(64);
+    size_t numOfCpus = 0;
+    caches.forEachCpu([&]() {
+        ++numOfCpus;
+        caches.deallocate(1, pool, caches.allocate(1, pool));
+    });
+    REQUIRE(numOfCpus == (size_t)CPU_COUNT(&allowed));
+    // the slots are cached by CPUs other than the current one too
+    caches.forEachCpu([&]() { caches.flush(1, pool); });
+    REQUIRE(pool.getNumberOfPools() == 0);
+    cpu_set_t restored;
+    REQUIRE(sched_getaffinity(0, sizeof(restored), &restored) == 0);
+    REQUIRE(CPU_EQUAL(&restored, &allowed));
+}
+
+TEST_CASE("Recorded traces hold the allocations and deallocations in order",
+          "[custom_new_delete]") {
+    char path[] = "/tmp/rpools_trace_XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE(fd >= 0);
+    close(fd);
+    REQUIRE(TraceRecorder::start(path));
+    REQUIRE(TraceRecorder::isRecording());
+    // more records than a single buffer holds
+    const size_t numOfObjects = TraceRecorder::BUFFER_RECORDS;
+    vector<void*> ptrs(numOfObjects);
+    for (size_t i = 0; i < numOfObjects; ++i) {
+        ptrs[i] = custom_new_no_throw(i % 200 + 1, 16);
+    }
+    for (size_t i = 0; i < numOfObjects; ++i) {
+        custom_delete(ptrs[i], i % 200 + 1, 16);
+    }
+    TraceRecorder::stop();
+    REQUIRE_FALSE(TraceRecorder::isRecording());
+    custom_flush_thread_cache();
+
+    FILE* file = fopen(path, "rb");
+    REQUIRE(file != nullptr);
+    rpools::TraceHeader header;
+    header.magic = 0;
+    REQUIRE(fread(&header, sizeof(header), 1, file) == 1);
+    REQUIRE(header.magic == rpools::TRACE_MAGIC);
+    REQUIRE(header.version == rpools::TRACE_VERSION);
+    vector<rpools::TraceRecord> records;
+    rpools::TraceRecord record;
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+        records.push_back(record);
+    }
+    fclose(file);
+    unlink(path);
+
+    // the vectors of the test are recorded too, so only the objects of the
+    // test are compared
+    size_t next = 0;
+    uint64_t lastTimestamp = 0;
+    for (auto& record : records) {
+        REQUIRE(record.timestamp >= lastTimestamp);
+        lastTimestamp = record.timestamp;
+        size_t i = next % numOfObjects;
+        if (next == numOfObjects * 2 ||
+            record.objectId != reinterpret_cast<uintptr_t>(ptrs[i]) ||
+            record.size != i % 200 + 1) {
+            continue;
+        }
+        REQUIRE(record.op == (next < numOfObjects ?
+                              rpools::TRACE_ALLOCATE :
+                              rpools::TRACE_DEALLOCATE));
+        REQUIRE(record.alignmentLog2 == 4);
+        ++next;
+    }
+    REQUIRE(next == numOfObjects * 2);
+}
@@ -3,12 +3,27 @@
 #include "TestObject.h"
 #include "TestObject2.h"
 #include "rpools/allocators/GlobalLinkedPool.hpp"
+#include "rpools/allocators/LockFreeGlobalLinkedPool.hpp"
 #include "rpools/allocators/NSGlobalLinkedPool.hpp"
+#include "rpools/allocators/SlotCache.hpp"
+#include "rpools/tools/CacheAligned.hpp"
+#include "rpools/tools/PageProvider.hpp"
+#include "rpools/tools/PoolMap.hpp"
+#include "rpools/tools/mallocator.hpp"
 using namespace rpools;
 
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
 #include <thread>
 #include <mutex>
 #include <vector>
+#ifdef RPOOLS_NUMA
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 template<typename P, typename T>
 void test_pool_size() {
@@ -18,7 +33,7 @@ void test_pool_size() {
     if (diff != 0) {
         size += alignof(T) - diff;
     }
-    size_t expectedSize = (getPageSize() - sizeof(PoolHeaderG)) / size;
+    size_t expectedSize = (getPoolSpan() - sizeof(PoolHeaderG)) / size;
     REQUIRE(glp.getPoolSize() == expectedSize);
 }
 
@@ -71,6 +86,12 @@ TEST_CASE("Allocating P objects returns correct pointers",
     SECTION("Allocate TestObject2s") {
         test_allocation_1<NSGlobalLinkedPool, TestObject2>();
     }
+    SECTION("Allocate TestObjects") {
+        test_allocation_1<LockFreeGlobalLinkedPool, TestObject>();
+    }
+    SECTION("Allocate TestObject2s") {
+        test_allocation_1<LockFreeGlobalLinkedPool, TestObject2>();
+    }
 }
 
 template<typename P, typename T>
@@ -201,8 +222,91 @@ TEST_CASE("A new pool allocates iff all the other pools are full",
     }
 }
 
-template<typename T>
-void performAllocAndDealloc(GlobalLinkedPool& lp, std::mutex& mtx) {
+#ifndef RPOOLS_AVL_FREE_POOLS
+template<typename P, typename T>
+void test_fullest_pool_is_preferred() {
+    P lp(sizeof(T), alignof(T));
+    size_t poolSize = lp.getPoolSize();
+    size_t size = poolSize * 2;
+    vector<T*> objs(size);
+    for (size_t i = 0; i < size; ++i) {
+        objs[i] = new (lp.allocate()) T();
+    }
+    // the first pool is almost full, the second one is almost empty
+    lp.deallocate(objs[0]);
+    for (size_t i = poolSize; i < size - 1; ++i) {
+        lp.deallocate(objs[i]);
+    }
+    objs[0] = new (lp.allocate()) T();
+    REQUIRE(((size_t)objs[0] & getPoolMask()) ==
+            ((size_t)objs[1] & getPoolMask()));
+    for (size_t i = 0; i < poolSize; ++i) {
+        lp.deallocate(objs[i]);
+    }
+    lp.deallocate(objs[size - 1]);
+    REQUIRE(lp.getNumberOfPools() == 0);
+}
+
+TEST_CASE("The fullest pool is used for allocations", "[GlobalLinkedPool]") {
+    SECTION("GLPool TestObject") {
+        test_fullest_pool_is_preferred<GlobalLinkedPool, TestObject>();
+    }
+    SECTION("GLPool TestObject2") {
+        test_fullest_pool_is_preferred<GlobalLinkedPool, TestObject2>();
+    }
+    SECTION("NSGLPool TestObject") {
+        test_fullest_pool_is_preferred<NSGlobalLinkedPool, TestObject>();
+    }
+    SECTION("NSGLPool TestObject2") {
+        test_fullest_pool_is_preferred<NSGlobalLinkedPool, TestObject2>();
+    }
+}
+#endif
+
+template<typename P, typename T>
+void test_empty_pools_are_cached() {
+    P lp(sizeof(T), alignof(T));
+    size_t size = lp.getPoolSize() + 1;
+    vector<void*> objs(size);
+    for (size_t i = 0; i < size; ++i) {
+        objs[i] = lp.allocate();
+    }
+    // the second pool becomes empty, but it is kept around
+    size_t emptyPool = (size_t)objs[size - 1] & getPoolMask();
+    lp.deallocate(objs[size - 1]);
+    REQUIRE(lp.getNumberOfEmptyPools() == 1);
+    objs[size - 1] = lp.allocate();
+    REQUIRE(((size_t)objs[size - 1] & getPoolMask()) == emptyPool);
+    REQUIRE(lp.getNumberOfEmptyPools() == 0);
+    lp.deallocate(objs[size - 1]);
+    REQUIRE(PoolMap::contains((void*)emptyPool));
+    lp.trim();
+    REQUIRE(lp.getNumberOfEmptyPools() == 0);
+    // the freed pool is not part of the pool map anymore
+    REQUIRE_FALSE(PoolMap::contains((void*)emptyPool));
+    // nothing is cached without a limit
+    lp.setEmptyPoolLimit(0);
+    for (size_t i = 0; i < size - 1; ++i) {
+        lp.deallocate(objs[i]);
+    }
+    REQUIRE(lp.getNumberOfEmptyPools() == 0);
+}
+
+TEST_CASE("Empty pools are cached until they are trimmed",
+          "[GlobalLinkedPool]") {
+    SECTION("GLPool") {
+        test_empty_pools_are_cached<GlobalLinkedPool, TestObject>();
+    }
+    SECTION("NSGLPool") {
+        test_empty_pools_are_cached<NSGlobalLinkedPool, TestObject>();
+    }
+    SECTION("LFGLPool") {
+        test_empty_pools_are_cached<LockFreeGlobalLinkedPool, TestObject>();
+    }
+}
+
+template<typename P, typename T>
+void performAllocAndDealloc(P& lp, std::mutex& mtx) {
     size_t BOUND = 100000;
     std::vector<T*> ptrs(BOUND);
     for (size_t i = 0; i < BOUND; ++i) {
@@ -217,14 +321,14 @@ void performAllocAndDealloc(GlobalLinkedPool& lp, std::mutex& mtx) {
     }
 }
 
-template<typename T>
+template<typename P, typename T>
 void test_pools_are_syncrhonized() {
     int threadsNo = 5;
     std::mutex mtx;
-    GlobalLinkedPool lp(sizeof(T), alignof(T));
+    P lp(sizeof(T), alignof(T));
     std::vector<std::thread> threads(threadsNo);
     for (int i = 0; i < threadsNo; ++i) {
-        threads[i] = std::thread(performAllocAndDealloc<T>,
+        threads[i] = std::thread(performAllocAndDealloc<P, T>,
                                  std::ref(lp),
                                  std::ref(mtx));
     }
@@ -236,9 +340,257 @@ void test_pools_are_syncrhonized() {
 
 TEST_CASE("Pools are synchronized", "[GlobalLinkedPool]") {
     SECTION("TestObject") {
-        test_pools_are_syncrhonized<TestObject>();
+        test_pools_are_syncrhonized<GlobalLinkedPool, TestObject>();
     }
     SECTION("TestObject2") {
-        test_pools_are_syncrhonized<TestObject2>();
+        test_pools_are_syncrhonized<GlobalLinkedPool, TestObject2>();
+    }
+    SECTION("Lock-free TestObject") {
+        test_pools_are_syncrhonized<LockFreeGlobalLinkedPool, TestObject>();
+    }
+    SECTION("Lock-free TestObject2") {
+        test_pools_are_syncrhonized<LockFreeGlobalLinkedPool, TestObject2>();
     }
 }
+
+template<typename P, typename T>
+void test_cross_thread_deallocation() {
+    size_t BOUND = 100000;
+    P lp(sizeof(T), alignof(T));
+    std::vector<T*> ptrs(BOUND);
+    std::thread producer([&]() {
+        for (size_t i = 0; i < BOUND; ++i) {
+            ptrs[i] = new (lp.allocate()) T();
+        }
+    });
+    producer.join();
+    // one thread allocates while the others free what the producer made
+    std::vector<std::thread> threads;
+    threads.emplace_back([&]() {
+        for (size_t i = 0; i < BOUND; ++i) {
+            lp.deallocate(lp.allocate());
+        }
+    });
+    size_t consumers = 3;
+    for (size_t c = 0; c < consumers; ++c) {
+        threads.emplace_back([&, c]() {
+            for (size_t i = c; i < BOUND; i += consumers) {
+                lp.deallocate(ptrs[i]);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    REQUIRE(lp.getNumberOfPools() == 0);
+}
+
+TEST_CASE("Objects can be deallocated by other threads", "[GlobalLinkedPool]") {
+    SECTION("TestObject") {
+        test_cross_thread_deallocation<GlobalLinkedPool, TestObject>();
+    }
+    SECTION("TestObject2") {
+        test_cross_thread_deallocation<GlobalLinkedPool, TestObject2>();
+    }
+    SECTION("Lock-free TestObject") {
+        test_cross_thread_deallocation<LockFreeGlobalLinkedPool, TestObject>();
+    }
+    SECTION("Lock-free TestObject2") {
+        test_cross_thread_deallocation<LockFreeGlobalLinkedPool,
+                                       TestObject2>();
+    }
+}
+
+template<typename P>
+void test_bulk_allocation() {
+    P lp(sizeof(TestObject), alignof(TestObject));
+    size_t size = lp.getPoolSize() + 2;
+    vector<void*> objs(size);
+    REQUIRE(lp.allocateBulk(objs.data(), size) == size);
+    REQUIRE(lp.getNumberOfPools() == 1);
+    REQUIRE(((size_t)objs[size - 1] & getPoolMask())
+            != ((size_t)objs[0] & getPoolMask()));
+    lp.deallocateBulk(objs.data(), 3);
+    REQUIRE(lp.getNumberOfPools() == 2);
+    REQUIRE(lp.allocateBulk(objs.data(), 3) == 3);
+    lp.deallocateBulk(objs.data(), size);
+    REQUIRE(lp.getNumberOfPools() == 0);
+}
+
+TEST_CASE("Bulk (de)allocation spans several pools", "[GlobalLinkedPool]") {
+    SECTION("GlobalLinkedPool") {
+        test_bulk_allocation<GlobalLinkedPool>();
+    }
+    SECTION("NSGlobalLinkedPool") {
+        test_bulk_allocation<NSGlobalLinkedPool>();
+    }
+    SECTION("LockFreeGlobalLinkedPool") {
+        test_bulk_allocation<LockFreeGlobalLinkedPool>();
+    }
+}
+
+TEST_CASE("Interleaved slots are released once per pool",
+          "[GlobalLinkedPool]") {
+    size_t span = getPoolSpan();
+    vector<char> memory(span * 3);
+    char* first = (char*)(((size_t)memory.data() + span - 1) & getPoolMask());
+    char* second = first + span;
+    vector<void*> slots;
+    for (size_t i = 1; i <= 4; ++i) {
+        slots.push_back(second + i * 64);
+        slots.push_back(first + i * 64);
+    }
+    vector<size_t> runs;
+    releaseByPool(slots.data(), slots.size(), [&](void** t_ptrs, size_t t_n) {
+        for (size_t i = 0; i < t_n; ++i) {
+            REQUIRE(((size_t)t_ptrs[i] & getPoolMask()) ==
+                    ((size_t)t_ptrs[0] & getPoolMask()));
+        }
+        runs.push_back(t_n);
+    });
+    REQUIRE(runs == vector<size_t>({4, 4}));
+}
+
+TEST_CASE("SlotCache refills and flushes in batches", "[SlotCache]") {
+    GlobalLinkedPool lp(sizeof(TestObject), alignof(TestObject));
+    SlotCache cache = SlotCache();
+    void* obj = cache.allocate(lp);
+    REQUIRE(obj != nullptr);
+    REQUIRE(cache.size() == SlotCache::REFILL_SIZE - 1);
+    REQUIRE(GlobalLinkedPool::getPoolHeader(obj).occupiedSlots ==
+            SlotCache::REFILL_SIZE);
+    // the most recently deallocated slot is the next one to be allocated
+    cache.deallocate(lp, obj);
+    REQUIRE(cache.allocate(lp) == obj);
+    vector<void*> objs(SlotCache::CAPACITY + 1);
+    objs[0] = obj;
+    for (size_t i = 1; i < objs.size(); ++i) {
+        objs[i] = cache.allocate(lp);
+    }
+    for (auto o : objs) {
+        cache.deallocate(lp, o);
+    }
+    REQUIRE(cache.size() <= SlotCache::CAPACITY);
+    cache.flush(lp);
+    REQUIRE(cache.size() == 0);
+    REQUIRE(lp.getNumberOfPools() == 0);
+}
+
+TEST_CASE("LMLock excludes threads that wait for it", "[LMLock]") {
+    LMLock lock;
+    size_t counter = 0;
+    size_t BOUND = 100000;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&]() {
+            for (size_t i = 0; i < BOUND; ++i) {
+                lock.lock();
+                ++counter;
+                lock.unlock();
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    REQUIRE(counter == 4 * BOUND);
+    REQUIRE(lock.try_lock());
+    REQUIRE_FALSE(lock.try_lock());
+    lock.unlock();
+#ifdef RPOOLS_LOCK_STATS
+    LockStats stats = lock.getStats();
+    REQUIRE(stats.acquisitions == 4 * BOUND + 1);
+    REQUIRE(stats.contentions <= 4 * BOUND);
+    // the pool locks are counted as well
+    GlobalLinkedPool lp(sizeof(TestObject), alignof(TestObject));
+    lp.deallocate(lp.allocate());
+    REQUIRE(lp.getLockStats().acquisitions == 2);
+    REQUIRE(lp.getLockStats().contentions == 0);
+#else
+    REQUIRE(lock.getStats().acquisitions == 0);
+#endif
+}
+
+TEST_CASE("Cache aligned pools do not share cache lines", "[GlobalLinkedPool]") {
+    using Entry = CacheAligned<GlobalLinkedPool>;
+    std::vector<Entry, mallocator<Entry>> pools;
+    for (size_t i = 1; i <= 4; ++i) {
+        pools.emplace_back(8 * i);
+    }
+    REQUIRE(sizeof(Entry) % CACHE_LINE_SIZE == 0);
+    for (auto& pool : pools) {
+        REQUIRE((size_t)&pool % CACHE_LINE_SIZE == 0);
+        pool.value.deallocate(pool.value.allocate());
+    }
+}
+
+#ifdef RPOOLS_NUMA
+TEST_CASE("Pools are allocated on the NUMA node of the thread",
+          "[GlobalLinkedPool]") {
+    GlobalLinkedPool lp(sizeof(TestObject), alignof(TestObject));
+    unsigned int node = getNumaNode();
+    void* obj = lp.allocate();
+    REQUIRE(GlobalLinkedPool::getPoolHeader(obj).numaSlot ==
+            getNumaSlot(node));
+    // the memory of the pool prefers the node of the thread
+    const unsigned int bitsPerLong = sizeof(unsigned long) * 8;
+    int mode;
+    unsigned long mask[1024 / bitsPerLong] = {};
+    REQUIRE(syscall(SYS_get_mempolicy, &mode, mask, 1024, obj,
+                    MPOL_F_ADDR) == 0);
+    REQUIRE(mode == MPOL_PREFERRED);
+    REQUIRE(mask[node / bitsPerLong] == 1UL << (node % bitsPerLong));
+    lp.deallocate(obj);
+    REQUIRE(lp.getNumberOfPools() == 0);
+}
+#endif
+
+TEST_CASE("Pools are aligned at their span and reused", "[PageProvider]") {
+#ifdef RPOOLS_HUGEPAGES
+    std::ifstream thp("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string modes((std::istreambuf_iterator<char>(thp)),
+                      std::istreambuf_iterator<char>());
+    if (modes.find("[never]") != std::string::npos) {
+        // the arenas are still usable, but backed by plain pages
+        WARN("transparent huge pages are disabled");
+    }
+#endif
+    size_t span = getPoolSpan();
+    vector<void*> pools;
+    for (size_t i = 0; i < 64; ++i) {
+        void* pool = allocatePool();
+        REQUIRE(pool != nullptr);
+        REQUIRE((size_t)pool % span == 0);
+        REQUIRE(PoolMap::contains(pool));
+        std::memset(pool, 0xab, span);
+        pools.push_back(pool);
+    }
+    vector<void*> sorted(pools);
+    std::sort(sorted.begin(), sorted.end());
+    for (size_t i = 1; i < sorted.size(); ++i) {
+        REQUIRE((size_t)sorted[i] - (size_t)sorted[i - 1] >= span);
+    }
+    for (void* pool : pools) {
+        deallocatePool(pool);
+        REQUIRE_FALSE(PoolMap::contains(pool));
+    }
+#ifdef RPOOLS_MMAP_ARENAS
+    // the arena hands out the pools that were given back first, whose
+    // memory may have been returned to the system but is still mapped
+    void* pool = allocatePool();
+    REQUIRE(std::find(pools.begin(), pools.end(), pool) != pools.end());
+    std::memset(pool, 0, span);
+    deallocatePool(pool);
+#endif
+}
+
+TEST_CASE("Addresses beyond 48 bits are outside the pool map",
+          "[PoolMap]") {
+    // such addresses are only handed out with 5-level paging, and are
+    // beyond the map whatever the span of the pools
+    const void* high = reinterpret_cast<const void*>(uintptr_t(1) << 62);
+    REQUIRE_FALSE(PoolMap::contains(high));
+    REQUIRE_FALSE(PoolMap::insert(high));
+    REQUIRE_FALSE(PoolMap::contains(reinterpret_cast<const void*>(
+        ~uintptr_t(0) & getPoolMask())));
+}
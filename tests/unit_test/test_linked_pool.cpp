@@ -8,7 +8,7 @@ using namespace rpools;
 template<typename T>
 void test_pool_size() {
     LinkedPool<T> lp;
-    size_t expectedSize = (getPageSize() - sizeof(PoolHeader)) / sizeof(T);
+    size_t expectedSize = (getPoolSpan() - sizeof(PoolHeader)) / sizeof(T);
     REQUIRE(lp.getPoolSize() == expectedSize);
 }
 
@@ -167,3 +167,79 @@ TEST_CASE("A new pool allocates iff all the other pools are full", "[LinkedPool]
         test_pools_fill_up<TestObject2>();
     }
 }
+
+TEST_CASE("Empty pools are cached until they are trimmed", "[LinkedPool]") {
+    LinkedPool<TestObject> lp;
+    size_t size = lp.getPoolSize() + 1;
+    vector<TestObject*> objs(size);
+    for (size_t i = 0; i < size; ++i) {
+        objs[i] = new (lp.allocate()) TestObject();
+    }
+    // the second pool becomes empty, but it is kept around
+    TestObject* last = objs[size - 1];
+    lp.deallocate(last);
+    REQUIRE(lp.getNumberOfEmptyPools() == 1);
+    REQUIRE(lp.allocate() == last);
+    lp.deallocate(last);
+    lp.trim();
+    REQUIRE(lp.getNumberOfEmptyPools() == 0);
+    lp.setEmptyPoolLimit(0);
+    for (size_t i = 0; i < size - 1; ++i) {
+        lp.deallocate(objs[i]);
+    }
+    REQUIRE(lp.getNumberOfEmptyPools() == 0);
+}
+
+TEST_CASE("Bulk (de)allocation returns slots to their pools", "[LinkedPool]") {
+    LinkedPool<TestObject> lp;
+    size_t size = lp.getPoolSize() * 2;
+    vector<void*> objs(size);
+    REQUIRE(lp.allocateBulk(objs.data(), size) == size);
+    REQUIRE(lp.getNumberOfPools() == 0);
+    // interleave the slots of the two pools
+    vector<void*> mixed;
+    for (size_t i = 0; i < size / 2; ++i) {
+        mixed.push_back(objs[i]);
+        mixed.push_back(objs[size / 2 + i]);
+    }
+    lp.deallocateBulk(mixed.data(), 2);
+    REQUIRE(lp.getNumberOfPools() == 2);
+    lp.deallocateBulk(mixed.data() + 2, mixed.size() - 2);
+    REQUIRE(lp.getNumberOfPools() == 0);
+    REQUIRE(lp.getNumberOfEmptyPools() == 1);
+}
+
+#ifndef RPOOLS_AVL_FREE_POOLS
+template<typename T>
+void test_fullest_pool_is_preferred() {
+    LinkedPool<T> lp;
+    size_t poolSize = lp.getPoolSize();
+    size_t size = poolSize * 2;
+    vector<T*> objs(size);
+    for (size_t i = 0; i < size; ++i) {
+        objs[i] = new (lp.allocate()) T();
+    }
+    // the first pool is almost full, the second one is almost empty
+    lp.deallocate(objs[0]);
+    for (size_t i = poolSize; i < size - 1; ++i) {
+        lp.deallocate(objs[i]);
+    }
+    objs[0] = new (lp.allocate()) T();
+    REQUIRE(((size_t)objs[0] & getPoolMask()) ==
+            ((size_t)objs[1] & getPoolMask()));
+    for (size_t i = 0; i < poolSize; ++i) {
+        lp.deallocate(objs[i]);
+    }
+    lp.deallocate(objs[size - 1]);
+    REQUIRE(lp.getNumberOfPools() == 0);
+}
+
+TEST_CASE("The fullest pool is used for allocations", "[LinkedPool]") {
+    SECTION("TestObject") {
+        test_fullest_pool_is_preferred<TestObject>();
+    }
+    SECTION("TestObject2") {
+        test_fullest_pool_is_preferred<TestObject2>();
+    }
+}
+#endif